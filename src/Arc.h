@@ -4,15 +4,16 @@
 #define INCLUDED_ARC
 
 #include <string>
-
-class Point;
+#include "Settings.h"
 
 class Arc {
 public:
-	Arc(Point *to, const std::string &id) : to(to), id(id), isStart(false) {}
-	Point *to;
+	Arc(Index to, const std::string &id, Index index) : id(id), to(to), index(index), isStart(false), isChain(false) {}
 	std::string id;
+	Index to; // in Network::points
+	Index index; // row number; both arcs of an edge share it
 	bool isStart;
+	bool isChain; // stands for a chain of arcs, see Network::contractChains
 };
 
 #endif //ndef INCLUDED_ARC
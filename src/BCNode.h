@@ -3,33 +3,67 @@
 #ifndef INCLUDED_NODE
 #define INCLUDED_NODE
 
+#include <cstddef>
 #include <vector>
 #include "Settings.h"
 
-class Point;
-
 class BCNode {
 public:
 	struct Neighbor {
-		Neighbor(BCNode *to, size_t reverseIndex) noexcept : to(to), reverseIndex(reverseIndex) {}
-		BCNode *to;
-		bool marked{ false };
-		int reverseIndex; // to->neighbors[reverseIndex] is the reverse arc to this
+		Index to;
+		Index reverse : 31; // Network::neighbors[reverse] is the reverse arc to this
+		Index marked : 1;
 	};
 
-	// Don't fool around with the neighbors vector by hand, use ::connect.
-	// This sets reverseIndex correctly.
-	small_vector<Neighbor> neighbors;
-	static void connect(BCNode *a, BCNode *b);
+	// Range in Network::neighbors, see Network::nodeNeighbors()
+	Index firstNeighbor{ 0 }, neighborCount{ 0 };
 
-	bool visited{ false };
+	unsigned visited{ 0 }; // see Network::epoch
+	unsigned counted{ 0 }; // same, for the cut vertex of a cut node in Network::countUpstreamFeatures
+	unsigned covered{ 0 }; // same, for the heavy path starting here in Network::upstreamText,
+	int coveredTin{ 0 };   // which has been output from this head down to coveredTin
 	bool hasStart{ false };
 	bool hasController{ false };
 
-	// Contents of this node
-	std::vector<Point*> points;
-	std::vector<std::string> edges;
-		
+	// Contents of this node: ranges in Network::blockPoints and
+	// Network::blockEdges, see Network::nodePoints() and Network::nodeEdges().
+	int firstPoint{ 0 }, pointsSize{ 0 };
+	int firstEdge{ 0 }, edgesSize{ 0 };
+
+	// Number of distinct points that are output for this node and no other:
+	// the points that are not articulations, but for a bridge only
+	// those that are controllers or starts.
+	int pointCount{ 0 };
+
+	// Euler tour of the tree rooted at a controller node, see Network::tourBCTree.
+	// The subtree of this node is tin <= x->tin < tout; it is in the core if its
+	// subtree has a controller, that is, if it lies between controllers.
+	// Its heavy path runs down from head through the heavy children.
+	Index parent{ NoIndex };
+	Index heavy{ NoIndex };
+	Index head{ NoIndex };
+	int tin{ 0 }, tout{ 0 };
+	int component{ -1 };
+	bool core{ false };
+	bool isAncestorOf(const BCNode &v) const noexcept { return tin <= v.tin && v.tin < tout; }
+
+	// Cut nodes have only their articulation point; blocks have at least one edge.
+	bool isCut() const noexcept { return edgesSize == 0; }
+	bool isBridge() const noexcept { return pointsSize == 2; }
+
+};
+
+// The points or edges of a node
+template< typename T >
+class ContentRange {
+public:
+	ContentRange(T *first, int size) noexcept : first(first), last(first + size) {}
+	T *begin() const noexcept { return first; }
+	T *end() const noexcept { return last; }
+	size_t size() const noexcept { return last - first; }
+	T &operator[](size_t i) const noexcept { return first[i]; }
+private:
+	T *first, *last;
 };
 
 #endif //ndef INCLUDED_NODE
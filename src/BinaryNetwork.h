@@ -0,0 +1,54 @@
+// Binary network format, which is loaded without parsing any text
+
+#ifndef INCLUDED_BINARY_NETWORK
+#define INCLUDED_BINARY_NETWORK
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// === Description ===
+// All numbers are little-endian; on other processors Network refuses to load
+// or save the format. The file consists of, in this order:
+//
+//   BinaryHeader                         32 bytes
+//   u64 idEnd[idCount]                   id i is text[idEnd[i-1] .. idEnd[i])
+//   char text[textSize]                  the ids, without separators,
+//                                        padded with zeros to a multiple of 8
+//   u32 via[rowCount]                    per row, the index of its id,
+//   u32 from[rowCount]                   of the point it comes from
+//   u32 to[rowCount]                     and of the point it goes to
+//   u32 controller[controllerCount]      indices of the controller points
+//
+// An id that is used as from or to is a point and must occur only once;
+// via ids may also occur in the dictionary as points, or more than once.
+// Since everything is aligned to its size, the file can be used in place
+// after mapping it to memory. Rows and controllers are loaded in order, so
+// a file written by Network::save_binary gives the same point numbers as
+// the network it was written from. See Network_binary.cpp.
+
+struct BinaryHeader {
+	char magic[8];                // BinaryMagic
+	std::uint32_t version;        // BinaryVersion
+	std::uint32_t idCount;
+	std::uint32_t rowCount;
+	std::uint32_t controllerCount;
+	std::uint64_t textSize;
+};
+static_assert(sizeof(BinaryHeader) == 32, "BinaryHeader has no padding");
+
+const char BinaryMagic[8] = { 'W', 'U', 'P', 'S', 'T', 'R', 'M', '\x1a' };
+const std::uint32_t BinaryVersion = 1;
+
+// Where the sections start, in bytes from the start of the file
+struct BinaryLayout {
+	explicit BinaryLayout(const BinaryHeader &header) noexcept;
+	std::size_t idEnd, text, via, from, to, controller;
+	std::size_t size; // of the whole file
+};
+
+// Does the file start with BinaryMagic? Reads the file, so call it only for
+// regular files.
+bool isBinaryNetwork(const std::string &filename);
+
+#endif //ndef INCLUDED_BINARY_NETWORK
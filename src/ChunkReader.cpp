@@ -0,0 +1,296 @@
+// Recent Microsoft compilers *really* don't like fopen,
+// but other's don't consistently have fopen_s.
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <algorithm>
+#include <cstring>
+#include <sys/stat.h>
+#ifdef _WIN32
+#include <io.h>
+#include <fcntl.h>
+#endif
+
+#include "Settings.h"
+#include "ChunkReader.h"
+
+#ifdef USE_ZLIB
+#include <zlib.h>
+#endif
+#ifdef USE_ZSTD
+#include <zstd.h>
+#endif
+
+using std::string;
+
+static Compression compressionOf(const unsigned char *magic, std::size_t size) {
+	if (size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b) return Compression::Gzip;
+	if (size >= 4 && magic[0] == 0x28 && magic[1] == 0xb5 && magic[2] == 0x2f && magic[3] == 0xfd) return Compression::Zstd;
+	return Compression::None;
+}
+
+bool isRegularFile(const string &filename) {
+	struct stat info;
+	return filename != "-" && stat(filename.c_str(), &info) == 0 && (info.st_mode & S_IFMT) == S_IFREG;
+}
+
+bool isStream(const string &filename) {
+	struct stat info;
+	return filename == "-" || (stat(filename.c_str(), &info) == 0 && (info.st_mode & S_IFMT) != S_IFREG);
+}
+
+Compression detectCompression(const string &filename) {
+	FILE *fp = fopen(filename.c_str(), fopenMode);
+	if (fp == nullptr) return Compression::None;
+	unsigned char magic[4];
+	const std::size_t size = fread(magic, 1, sizeof magic, fp);
+	fclose(fp);
+	return compressionOf(magic, size);
+}
+
+ChunkReader::ChunkReader(const string &filename) {
+	FILE *fp;
+	if (filename == "-") {
+#ifdef _WIN32
+		_setmode(_fileno(stdin), _O_BINARY);
+#endif
+		fp = stdin;
+	}
+	else fp = fopen(filename.c_str(), fopenMode);
+	if (fp == nullptr) {
+		message = "Cannot open network file " + filename;
+		done = true;
+		return;
+	}
+	thread = std::thread(&ChunkReader::run, this, fp);
+}
+
+ChunkReader::~ChunkReader() {
+	{
+		std::lock_guard<std::mutex> lock(mutex);
+		stopping = true;
+	}
+	changed.notify_all();
+	if (thread.joinable()) thread.join();
+}
+
+bool ChunkReader::next(const char *&data, std::size_t &size) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (current.data != nullptr) {
+		spare.push_back(std::move(current));
+		current = Chunk{};
+		changed.notify_all();
+	}
+	changed.wait(lock, [this] { return !full.empty() || done; });
+	if (full.empty()) return false;
+	current = std::move(full.front());
+	full.pop_front();
+	data = current.data.get();
+	size = current.size;
+	return true;
+}
+
+bool ChunkReader::peek(const char *&data, std::size_t &size) {
+	std::unique_lock<std::mutex> lock(mutex);
+	changed.wait(lock, [this] { return !full.empty() || done; });
+	if (full.empty()) return false;
+	data = full.front().data.get();
+	size = full.front().size;
+	return true;
+}
+
+bool ChunkReader::failed() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return !message.empty();
+}
+
+string ChunkReader::error() const {
+	std::lock_guard<std::mutex> lock(mutex);
+	return message;
+}
+
+LargeBuffer readAll(ChunkReader &reader, std::size_t &length) {
+	std::size_t capacity = 0;
+	length = 0;
+	LargeBuffer buffer;
+	const char *data;
+	std::size_t size;
+	while (reader.next(data, size)) {
+		if (length + size + 1 > capacity) {
+			capacity = std::max(2 * capacity, length + size + 1);
+			LargeBuffer larger = allocateBuffer(capacity);
+			if (length != 0) std::copy(buffer.get(), buffer.get() + length, larger.get());
+			buffer = std::move(larger);
+		}
+		std::copy(data, data + size, buffer.get() + length);
+		length += size;
+	}
+	if (reader.failed()) return nullptr;
+	if (buffer == nullptr) buffer = allocateBuffer(1);
+	buffer[length] = '\0';
+	return buffer;
+}
+
+//=== On the reading thread ==================================================
+
+// Hand over the filled chunk (if any), wait for a free one, and return that
+// in its place, empty. False if the reader is stopping.
+bool ChunkReader::emit(Chunk &chunk) {
+	std::unique_lock<std::mutex> lock(mutex);
+	if (chunk.data != nullptr && chunk.size != 0) {
+		full.push_back(std::move(chunk));
+		changed.notify_all();
+	}
+	changed.wait(lock, [this] { return stopping || !spare.empty() || chunks < ChunkCount; });
+	if (stopping) return false;
+	if (!spare.empty()) {
+		chunk = std::move(spare.back());
+		spare.pop_back();
+	}
+	else if (chunk.data == nullptr) {
+		chunk.data.reset(new char[ChunkSize]);
+		++chunks;
+	}
+	chunk.size = 0;
+	return true;
+}
+
+void ChunkReader::fail(const string &error) {
+	std::lock_guard<std::mutex> lock(mutex);
+	message = error;
+}
+
+// Like fread, but starts with the bytes that were read to detect compression.
+std::size_t ChunkReader::read(FILE *fp, char *buffer, std::size_t size) {
+	std::size_t n = 0;
+	while (magicUsed < magicSize && n < size) buffer[n++] = static_cast<char>(magic[magicUsed++]);
+	return n + fread(buffer + n, 1, size - n, fp);
+}
+
+// Uncompressed input goes straight into the chunks.
+void ChunkReader::copy(FILE *fp) {
+	Chunk chunk{};
+	while (emit(chunk)) {
+		chunk.size = read(fp, chunk.data.get(), ChunkSize);
+		if (chunk.size < ChunkSize) {
+			if (ferror(fp)) fail("Cannot read network file");
+			else if (chunk.size != 0) emit(chunk);
+			return;
+		}
+	}
+}
+
+// Feed the input to decodeInput in blocks. It writes to the free room in the
+// chunk and returns how much input it used, or -1 after an error. It is
+// called until the input is used up and it no longer fills the chunk, so no
+// output stays behind in the decoder.
+template< typename Decode >
+void ChunkReader::decode(FILE *fp, Decode decodeInput) {
+	const std::size_t InputSize = std::size_t(1) << 18;
+	std::unique_ptr<char[]> input(new char[InputSize]);
+	std::size_t begin = 0, end = 0;
+	bool eof = false, pending = false;
+	Chunk chunk{};
+	if (!emit(chunk)) return;
+	while (true) {
+		if (begin == end && !eof) {
+			begin = 0;
+			end = read(fp, input.get(), InputSize);
+			if (end < InputSize) {
+				if (ferror(fp)) return fail("Cannot read network file");
+				eof = true;
+			}
+		}
+		if (begin == end && !pending) break;
+		const std::size_t room = ChunkSize - chunk.size;
+		std::size_t produced = 0;
+		const long used = decodeInput(input.get() + begin, end - begin, chunk.data.get() + chunk.size, room, produced);
+		if (used < 0) return;
+		if (used == 0 && produced == 0) {
+			if (begin != end) fail("Cannot decompress network file");
+			break;
+		}
+		begin += static_cast<std::size_t>(used);
+		chunk.size += produced;
+		pending = produced == room;
+		if (chunk.size == ChunkSize && !emit(chunk)) return;
+	}
+	if (chunk.size != 0) emit(chunk);
+}
+
+void ChunkReader::run(FILE *fp) {
+	magicSize = fread(magic, 1, sizeof magic, fp);
+	switch (compressionOf(magic, magicSize)) {
+	case Compression::None:
+		copy(fp);
+		break;
+	case Compression::Gzip: {
+#ifdef USE_ZLIB
+		z_stream z;
+		std::memset(&z, 0, sizeof z);
+		const int init = inflateInit2(&z, 15 + 32); // gzip or zlib header
+		if (init != Z_OK) {
+			fail(string("Cannot decompress network file: ") + zError(init));
+			break;
+		}
+		bool ended = false;
+		decode(fp, [&](const char *in, std::size_t inSize, char *out, std::size_t outSize, std::size_t &produced) -> long {
+			if (ended) {
+				// Files may consist of several gzip members in a row
+				if (inSize == 0) return 0;
+				inflateReset(&z);
+				ended = false;
+			}
+			z.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(in));
+			z.avail_in = static_cast<uInt>(inSize);
+			z.next_out = reinterpret_cast<Bytef*>(out);
+			z.avail_out = static_cast<uInt>(outSize);
+			const int result = inflate(&z, Z_NO_FLUSH);
+			if (result == Z_STREAM_END) ended = true;
+			else if (result != Z_OK && result != Z_BUF_ERROR) {
+				fail(string("Cannot decompress network file: ") + (z.msg ? z.msg : "gzip error"));
+				return -1;
+			}
+			produced = outSize - z.avail_out;
+			return static_cast<long>(inSize - z.avail_in);
+		});
+		if (!ended && !failed()) fail("Cannot decompress network file: it ends too soon");
+		inflateEnd(&z);
+#else
+		fail("This build cannot read gzip files; define USE_ZLIB in Settings.h");
+#endif
+		break;
+	}
+	case Compression::Zstd: {
+#ifdef USE_ZSTD
+		ZSTD_DStream *z = ZSTD_createDStream();
+		if (z == nullptr || ZSTD_isError(ZSTD_initDStream(z))) {
+			ZSTD_freeDStream(z);
+			fail("Cannot decompress network file: out of memory");
+			break;
+		}
+		std::size_t hint = 0;
+		decode(fp, [&](const char *in, std::size_t inSize, char *out, std::size_t outSize, std::size_t &produced) -> long {
+			ZSTD_inBuffer input = { in, inSize, 0 };
+			ZSTD_outBuffer output = { out, outSize, 0 };
+			hint = ZSTD_decompressStream(z, &output, &input);
+			if (ZSTD_isError(hint)) {
+				fail(string("Cannot decompress network file: ") + ZSTD_getErrorName(hint));
+				return -1;
+			}
+			produced = output.pos;
+			return static_cast<long>(input.pos);
+		});
+		// The last frame is complete if zstd asks for no more input
+		if (hint != 0 && !failed()) fail("Cannot decompress network file: it ends too soon");
+		ZSTD_freeDStream(z);
+#else
+		fail("This build cannot read zstd files; define USE_ZSTD in Settings.h");
+#endif
+		break;
+	}
+	}
+	if (fp != stdin) fclose(fp);
+	std::lock_guard<std::mutex> lock(mutex);
+	done = true;
+	changed.notify_all();
+}
@@ -0,0 +1,95 @@
+// Reading (and decompressing) an input file on a separate thread
+
+#ifndef INCLUDED_CHUNK_READER
+#define INCLUDED_CHUNK_READER
+
+#include <cstddef>
+#include <cstdio>
+#include <string>
+#include <memory>
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "HugePages.h"
+
+// === Description ===
+// A thread reads the file (or standard input, given as "-") and decompresses it if it is gzip (with USE_ZLIB)
+// or zstd (with USE_ZSTD), see Settings.h, and hands it over in chunks of
+// ChunkSize bytes through a queue of at most ChunkCount chunks. Reading,
+// decompressing and parsing then overlap, and memory use is bounded.
+// The input is read front to back only once, so it may be a pipe.
+//
+// Usage: ChunkReader reader(filename);
+//        const char *data; size_t size;
+//        while (reader.next(data, size)) { ... }
+//        if (reader.failed()) std::cerr << reader.error() << "\n";
+
+enum class Compression { None, Gzip, Zstd };
+
+// Is this a regular file, which can be sized and read twice? Not so for
+// standard input ("-"), pipes and process substitution.
+bool isRegularFile(const std::string &filename);
+
+// Is this standard input, or a file that exists but is not a regular file,
+// such as a pipe? False for a file that does not exist.
+bool isStream(const std::string &filename);
+
+// What the file starts with; None if it cannot be read.
+// Reads the file, so call it only for regular files.
+Compression detectCompression(const std::string &filename);
+
+class ChunkReader {
+public:
+	static const std::size_t ChunkSize = std::size_t(4) << 20;
+	static const std::size_t ChunkCount = 4;
+
+	explicit ChunkReader(const std::string &filename);
+	~ChunkReader();
+	ChunkReader(const ChunkReader&) = delete;
+	ChunkReader &operator=(const ChunkReader&) = delete;
+
+	// The next chunk, valid until the next call. False at the end of the
+	// input or after an error.
+	bool next(const char *&data, std::size_t &size);
+	// The chunk that next will give, without taking it, to look at the
+	// start of the input. False at the end of the input or after an error.
+	bool peek(const char *&data, std::size_t &size);
+
+	// Did reading or decompressing fail? Only final after next returned false.
+	bool failed() const;
+	std::string error() const;
+
+private:
+	struct Chunk {
+		std::unique_ptr<char[]> data;
+		std::size_t size;
+	};
+	void run(FILE *fp);
+	std::size_t read(FILE *fp, char *buffer, std::size_t size);
+	void copy(FILE *fp);
+	template< typename Decode > void decode(FILE *fp, Decode decodeInput);
+	bool emit(Chunk &chunk); // hand over; false if the reader is stopping
+	void fail(const std::string &message);
+
+	std::thread thread;
+	mutable std::mutex mutex;
+	std::condition_variable changed;
+	std::deque<Chunk> full;  // read, not yet handed out
+	std::vector<Chunk> spare; // handed back, to be filled again
+	Chunk current{};          // handed out by next
+	std::size_t chunks{ 0 };  // in existence, at most ChunkCount
+	bool done{ false };       // the thread has finished
+	bool stopping{ false };   // the reader is destructed early
+	std::string message;
+	unsigned char magic[4]; // the first bytes, read to detect compression
+	std::size_t magicSize{ 0 }, magicUsed{ 0 };
+};
+
+// All of the input in one buffer, followed by '\0'; nullptr if reading failed
+// (see ChunkReader::error). The buffer grows as the chunks come in.
+LargeBuffer readAll(ChunkReader &reader, std::size_t &length);
+
+#endif //ndef INCLUDED_CHUNK_READER
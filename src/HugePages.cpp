@@ -0,0 +1,54 @@
+#include "Settings.h"
+#include "HugePages.h"
+
+#if defined(HUGE_PAGES) && defined(__linux__)
+#include <sys/mman.h>
+
+const std::size_t HugePageSize = std::size_t(2) << 20;
+
+// freeLarge unmaps in multiples of HugePageSize, so ask for pages of that size
+// rather than the system default, which may be 1 GiB.
+#if defined(MAP_HUGETLB) && !defined(MAP_HUGE_2MB) && defined(MAP_HUGE_SHIFT)
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+
+static std::size_t roundUp(std::size_t bytes) noexcept {
+	return (bytes + HugePageSize - 1) & ~(HugePageSize - 1);
+}
+
+void *allocateLarge(std::size_t bytes) {
+	if (bytes < LargeAllocation) return ::operator new(bytes);
+	const std::size_t size = roundUp(bytes);
+#if defined(MAP_HUGETLB) && defined(MAP_HUGE_2MB)
+	void *p = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | MAP_HUGE_2MB, -1, 0);
+	if (p != MAP_FAILED) return p;
+#endif
+	// Map one huge page more than needed, and cut off the ends to align it
+	char *q = static_cast<char*>(mmap(nullptr, size + HugePageSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+	if (q == MAP_FAILED) throw std::bad_alloc();
+	char *aligned = reinterpret_cast<char*>(roundUp(reinterpret_cast<std::size_t>(q)));
+	if (aligned != q) munmap(q, aligned - q);
+	if (aligned + size != q + size + HugePageSize) munmap(aligned + size, q + HugePageSize - aligned);
+#ifdef MADV_HUGEPAGE
+	madvise(aligned, size, MADV_HUGEPAGE);
+#endif
+	return aligned;
+}
+
+void freeLarge(void *p, std::size_t bytes) noexcept {
+	if (p == nullptr) return;
+	if (bytes < LargeAllocation) ::operator delete(p);
+	else munmap(p, roundUp(bytes));
+}
+
+#else
+
+void *allocateLarge(std::size_t bytes) {
+	return ::operator new(bytes);
+}
+
+void freeLarge(void *p, std::size_t) noexcept {
+	::operator delete(p);
+}
+
+#endif
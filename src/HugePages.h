@@ -0,0 +1,48 @@
+// Memory for the large arrays of the network and the input buffer
+
+#ifndef INCLUDED_HUGE_PAGES
+#define INCLUDED_HUGE_PAGES
+
+#include <cstddef>
+#include <memory>
+#include <new>
+
+// === Description ===
+// The DFS jumps all over the arrays of a large network, so with 4 KiB pages
+// it spends much of its time on TLB misses. With HUGE_PAGES defined (see
+// Settings.h), allocations of at least LargeAllocation bytes are mapped
+// separately on Linux: first with MAP_HUGETLB, which needs huge pages to be
+// reserved by the administrator, and otherwise as an ordinary mapping aligned
+// to 2 MiB with madvise(MADV_HUGEPAGE), which asks for transparent huge pages.
+// Everything else, and everything on other systems, comes from operator new.
+//
+// Usage: large_vector<Index> v;                  // see Settings.h
+//        LargeBuffer b = allocateBuffer(bytes);  // char[], freed by b
+
+const std::size_t LargeAllocation = std::size_t(2) << 20;
+
+void *allocateLarge(std::size_t bytes);
+void freeLarge(void *p, std::size_t bytes) noexcept;
+
+template< typename T >
+class HugePageAllocator {
+public:
+	using value_type = T;
+	HugePageAllocator() = default;
+	template< typename U > HugePageAllocator(const HugePageAllocator<U>&) noexcept {}
+	T *allocate(std::size_t n) { return static_cast<T*>(allocateLarge(n * sizeof(T))); }
+	void deallocate(T *p, std::size_t n) noexcept { freeLarge(p, n * sizeof(T)); }
+	template< typename U > bool operator==(const HugePageAllocator<U>&) const noexcept { return true; }
+	template< typename U > bool operator!=(const HugePageAllocator<U>&) const noexcept { return false; }
+};
+
+struct LargeBufferDeleter {
+	std::size_t bytes;
+	void operator()(char *p) const noexcept { freeLarge(p, bytes); }
+};
+using LargeBuffer = std::unique_ptr<char[], LargeBufferDeleter>;
+inline LargeBuffer allocateBuffer(std::size_t bytes) {
+	return LargeBuffer(static_cast<char*>(allocateLarge(bytes)), LargeBufferDeleter{ bytes });
+}
+
+#endif //ndef INCLUDED_HUGE_PAGES
@@ -0,0 +1,79 @@
+#include <utility>
+
+#include "Interner.h"
+#include "Util.h"
+
+ConcurrentInterner::ConcurrentInterner(std::size_t expected) {
+	std::size_t tableSize = 16;
+	while (tableSize < 2 * (expected / Shards + 1)) tableSize *= 2;
+	for (Shard &shard : shards) {
+		shard.table.assign(tableSize, Slot{ 0, NoIndex });
+		shard.slots = shard.table.data();
+		shard.mask = tableSize - 1;
+	}
+}
+
+Index ConcurrentInterner::intern(const std::string &s, std::uint32_t hash) {
+	Shard &shard = shards[hash >> (32 - ShardBits)];
+	std::lock_guard<std::mutex> guard(shard.lock);
+	if (2 * (shard.strings.size() + 1) > shard.table.size()) shard.grow();
+	const std::size_t mask = shard.table.size() - 1;
+	for (std::size_t i = hash & mask; ; i = (i + 1) & mask) {
+		Slot &slot = shard.table[i];
+		if (slot.entry == NoIndex) {
+			slot.hash = hash;
+			slot.entry = static_cast<Index>(shard.strings.size());
+			shard.strings.push_back(s);
+			shard.numbers.push_back(next++);
+			return shard.numbers.back();
+		}
+		if (slot.hash == hash && shard.strings[slot.entry] == s) return shard.numbers[slot.entry];
+	}
+}
+
+// Every lookup misses the cache on its slot, so the slot of the string Ahead
+// places further is prefetched first. Another thread may just have replaced
+// that table, but a prefetch is only a hint and cannot fault.
+void ConcurrentInterner::intern(const std::string *s, const std::uint32_t *hashes, std::size_t n, Index *numbers) {
+	const std::size_t Ahead = 16;
+	const auto fetch = [this, hashes](std::size_t i) {
+		const Shard &shard = shards[hashes[i] >> (32 - ShardBits)];
+		prefetch(shard.slots.load(std::memory_order_relaxed) + (hashes[i] & shard.mask.load(std::memory_order_relaxed)));
+	};
+	for (std::size_t i = 0; i < n && i < Ahead; ++i) fetch(i);
+	for (std::size_t i = 0; i < n; ++i) {
+		if (i + Ahead < n) fetch(i + Ahead);
+		numbers[i] = intern(s[i], hashes[i]);
+	}
+}
+
+// Double the table, without looking at the strings
+void ConcurrentInterner::Shard::grow() {
+	std::vector<Slot> old(2 * table.size(), Slot{ 0, NoIndex });
+	old.swap(table);
+	const std::size_t newMask = table.size() - 1;
+	for (const Slot &slot : old) {
+		if (slot.entry == NoIndex) continue;
+		std::size_t i = slot.hash & newMask;
+		while (table[i].entry != NoIndex) i = (i + 1) & newMask;
+		table[i] = slot;
+	}
+	slots = table.data();
+	mask = newMask;
+}
+
+std::vector<std::string> ConcurrentInterner::take() {
+	std::vector<std::string> byNumber(next.load());
+	for (Shard &shard : shards) {
+		for (std::size_t e = 0; e < shard.strings.size(); ++e) {
+			byNumber[shard.numbers[e]] = std::move(shard.strings[e]);
+		}
+		std::vector<Slot>(16, Slot{ 0, NoIndex }).swap(shard.table);
+		shard.slots = shard.table.data();
+		shard.mask = shard.table.size() - 1;
+		std::vector<std::string>().swap(shard.strings);
+		std::vector<Index>().swap(shard.numbers);
+	}
+	next = 0;
+	return byNumber;
+}
@@ -0,0 +1,66 @@
+// Giving strings dense numbers from several threads at once
+
+#ifndef INCLUDED_INTERNER
+#define INCLUDED_INTERNER
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "Settings.h"
+
+// === Description ===
+// ConcurrentInterner gives every distinct string a number 0, 1, 2, ..., the
+// next one for a string it has not seen before, and may be called from
+// several threads at the same time. The strings are divided over Shards
+// tables by the top bits of their hash, each with its own lock, so threads
+// rarely wait for each other; within a shard, the low bits of the hash pick
+// the slot, with linear probing as in Network's pointTable.
+//
+// The hash is passed in, so that it is computed outside the lock. Which
+// string gets which number depends on the order in which the threads get
+// there; to get numbers that do not, renumber the strings in order of first
+// use afterwards, as Network::load_lines does.
+
+class ConcurrentInterner {
+public:
+	// Room for about this many strings before any table has to grow
+	explicit ConcurrentInterner(std::size_t expected = 0);
+	ConcurrentInterner(const ConcurrentInterner&) = delete;
+	ConcurrentInterner &operator=(const ConcurrentInterner&) = delete;
+
+	// The number of this string, given its hash; a new one if it is new.
+	Index intern(const std::string &s, std::uint32_t hash);
+	// The numbers of n strings, prefetching the slots of later ones
+	void intern(const std::string *s, const std::uint32_t *hashes, std::size_t n, Index *numbers);
+
+	// Once no thread is interning any more: the number of strings, and the
+	// strings by number, moved out of the interner (which is empty after).
+	std::size_t size() const noexcept { return next.load(); }
+	std::vector<std::string> take();
+
+	static const int ShardBits = 6;
+	static const std::size_t Shards = std::size_t(1) << ShardBits;
+
+private:
+	struct Slot {
+		std::uint32_t hash;
+		Index entry; // in strings and numbers; NoIndex if the slot is empty
+	};
+	struct alignas(64) Shard {
+		std::mutex lock;
+		std::vector<Slot> table; // size a power of two, at most half full
+		// Where the table is, for prefetching without taking the lock
+		std::atomic<const Slot*> slots{ nullptr };
+		std::atomic<std::size_t> mask{ 0 };
+		std::vector<std::string> strings;
+		std::vector<Index> numbers;
+		void grow();
+	};
+	Shard shards[Shards];
+	std::atomic<Index> next{ 0 };
+};
+
+#endif //ndef INCLUDED_INTERNER
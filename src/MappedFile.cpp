@@ -0,0 +1,56 @@
+#include <iostream>
+
+#include "Settings.h"
+#include "MappedFile.h"
+#include "ChunkReader.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define MAP_FILES
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::open(const std::string &filename) {
+#ifdef MAP_FILES
+	if (isRegularFile(filename) && detectCompression(filename) == Compression::None) {
+		const int fd = ::open(filename.c_str(), O_RDONLY);
+		struct stat info;
+		if (fd < 0 || fstat(fd, &info) != 0) {
+			if (fd >= 0) close(fd);
+			std::cerr << "Cannot open network file " << filename << "\n";
+			return false;
+		}
+		length = static_cast<std::size_t>(info.st_size);
+		if (length != 0) {
+			mapping = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+			if (mapping == MAP_FAILED) mapping = nullptr;
+		}
+		close(fd);
+		if (mapping != nullptr) {
+			madvise(mapping, length, MADV_WILLNEED);
+			contents = static_cast<const char*>(mapping);
+			return true;
+		}
+		if (length != 0) {
+			std::cerr << "Cannot map network file " << filename << "\n";
+			return false;
+		}
+	}
+#endif
+	ChunkReader reader(filename);
+	buffer = readAll(reader, length);
+	if (buffer == nullptr) {
+		std::cerr << reader.error() << "\n";
+		return false;
+	}
+	contents = buffer.get();
+	return true;
+}
+
+MappedFile::~MappedFile() {
+#ifdef MAP_FILES
+	if (mapping != nullptr) munmap(mapping, length);
+#endif
+}
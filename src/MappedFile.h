@@ -0,0 +1,40 @@
+// A network file in memory, for the loaders that only read it
+
+#ifndef INCLUDED_MAPPED_FILE
+#define INCLUDED_MAPPED_FILE
+
+#include <cstddef>
+#include <string>
+
+#include "HugePages.h"
+
+// === Description ===
+// A regular, uncompressed file is mapped to memory on systems with mmap, so
+// nothing is copied and several threads can start on it at once. Anything
+// else (pipes, compressed files, other systems) is read into a buffer
+// through a ChunkReader. Either way the contents are read-only, and start at
+// an address aligned to at least 8 bytes.
+//
+// Usage: MappedFile file;
+//        if (!file.open(filename)) ... // reported on std::cerr
+//        use file.data()[0 .. file.size())
+
+class MappedFile {
+public:
+	MappedFile() = default;
+	~MappedFile();
+	MappedFile(const MappedFile&) = delete;
+	MappedFile &operator=(const MappedFile&) = delete;
+
+	bool open(const std::string &filename);
+	const char *data() const noexcept { return contents; }
+	std::size_t size() const noexcept { return length; }
+
+private:
+	const char *contents{ nullptr };
+	std::size_t length{ 0 };
+	void *mapping{ nullptr };
+	LargeBuffer buffer;
+};
+
+#endif //ndef INCLUDED_MAPPED_FILE
@@ -6,16 +6,25 @@ using std::get;
 using std::min;
 
 #include <tuple>
+using std::tuple;
 using std::make_tuple;
 
+#include <vector>
+using std::vector;
+
 using std::ostream;
 
 #include "rapidjson.h"
 using namespace rapidjson;
 
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
+
 #include "Timer.h"
 
 #include "Network.h"
+#include "Util.h"
 #include "Point.h"
 #include "Arc.h"
 #include "BCNode.h"
@@ -23,19 +32,91 @@ using namespace rapidjson;
 #include "Log.h"
 
 void Network::addEdge(const string &fromId, const string &toId, const string &viaId) {
-	Point *from = getOrMake(fromId);
-	Point *to = getOrMake(toId);
-	from->arcs.push_back(new(arcPool.malloc()) Arc(to, viaId));
-	to->arcs.push_back(new(arcPool.malloc()) Arc(from, viaId));
-	if (startingIds.count(viaId)) {
-		from->arcs.back()->isStart = true;
-		to->arcs.back()->isStart = true;
+	const Index from = getOrMake(fromId);
+	const Index to = getOrMake(toId);
+	const Index index = edgeCount++;
+	const bool isStart = startingIds.count(viaId) > 0;
+	arcs.emplace_back(to, viaId, index);
+	arcs.back().isStart = isStart;
+	arcs.emplace_back(from, viaId, index);
+	arcs.back().isStart = isStart;
+}
+
+// Every lookup of an id misses the cache twice or three times: on the
+// slot in pointTable, on the Point it refers to, and on the text of its id.
+// So the ids of a slice of the batch are hashed first, and while looking up
+// each id in order, the slot of the id Ahead places further is prefetched, the
+// Point of the one two thirds as far, and the text of the one a third as far,
+// each from what the previous prefetch brought in. The table is grown first,
+// so it does not move in between. The slices keep the scratch space small
+// when the batch is a whole file, as in load_lines.
+void Network::addEdges(const RowBatch &batch) {
+	const size_t Ahead = 24, Slice = RowBatch::Rows;
+	for (size_t first = 0; first < batch.rows(); first += Slice) {
+		const size_t rows = std::min(batch.rows() - first, Slice);
+		const size_t n = 2 * rows;
+		while (2 * (points.size() + n + 1) > pointTable.size()) growPointTable();
+		const size_t mask = pointTable.size() - 1;
+
+		batchIds.resize(n);
+		batchHashes.resize(n);
+		batchPoints.resize(n);
+		for (size_t r = 0; r < rows; ++r) {
+			batch.id(3 * (first + r) + 1, batchIds[2 * r]);
+			batch.id(3 * (first + r) + 2, batchIds[2 * r + 1]);
+		}
+		for (size_t i = 0; i < n; ++i) {
+			batchHashes[i] = hashId(batchIds[i]);
+			if (i < Ahead) prefetch(&pointTable[batchHashes[i] & mask]);
+		}
+		for (size_t i = 0; i < n; ++i) {
+			if (i + Ahead < n) prefetch(&pointTable[batchHashes[i + Ahead] & mask]);
+			if (i + 2 * Ahead / 3 < n) {
+				const Index p = pointTable[batchHashes[i + 2 * Ahead / 3] & mask].point;
+				if (p != NoIndex) prefetch(&points[p]);
+			}
+			if (i + Ahead / 3 < n) {
+				const Index p = pointTable[batchHashes[i + Ahead / 3] & mask].point;
+				if (p != NoIndex) prefetch(points[p].id.data());
+			}
+			batchPoints[i] = getOrMake(batchIds[i], batchHashes[i]);
+		}
+		addEdges(batch, first, rows, batchPoints.data());
+	}
+}
+
+void Network::addEdges(const RowBatch &batch, const Index *rowPoints) {
+	addEdges(batch, 0, batch.rows(), rowPoints);
+}
+
+void Network::addEdges(const RowBatch &batch, size_t first, size_t count, const Index *rowPoints) {
+	string via;
+	for (size_t r = 0; r < count; ++r) {
+		batch.id(3 * (first + r), via);
+		const Index index = edgeCount++;
+		const bool isStart = !startingIds.empty() && startingIds.count(via) > 0;
+		arcs.emplace_back(rowPoints[2 * r + 1], via, index);
+		arcs.back().isStart = isStart;
+		arcs.emplace_back(rowPoints[2 * r], via, index);
+		arcs.back().isStart = isStart;
 	}
 }
 
 void Network::enumerateUpstreamFeatures( ostream *result_stream ) {
+	TextSink sink(*result_stream);
+	enumerateUpstreamFeatures(sink);
+}
 
-	outstream = result_stream;
+void Network::buildIndex() {
+	if (indexed) return;
+	indexed = true;
+
+	if (relabeling != Relabeling::None) {
+		log() << "Relabel                     ... ";
+		const Timer relabelTime;
+		relabel();
+		relabelTime.report();
+	}
 
 	log() << "Block-cut tree              ... ";
 	const Timer bctTime;
@@ -44,128 +125,220 @@ void Network::enumerateUpstreamFeatures( ostream *result_stream ) {
 
 	log() << "Mark controllers            ... ";
 	const Timer markTime;
-	for (BCNode *c : controllerNodes) {
-		markTowardController(c, nullptr);
+	for (Index c : controllerNodes) {
+		markTowardController(c, NoIndex);
 	}
 	markTime.report();
+}
 
-	log() << "Output upstream features    ... ";
-	const Timer outputTime;
-	for (BCNode *s : startNodes) {
-		floodFromStartnode(s, nullptr);
-	}
-	outputTime.report();
+void Network::compact() {
+	if (compacted) return;
+	compacted = true;
+	buildIndex();
+
+	log() << "Compact                     ... ";
+	const Timer compactTime;
+	large_vector<PointState>().swap(pointState);
+	large_vector<Index>().swap(adjacency);
+	large_vector<Index>().swap(adjacentPoints);
+	std::vector<std::tuple<Index, Index>>().swap(bcStack);
+	std::unordered_set<std::string>().swap(startingIds);
+	std::vector<std::string>().swap(batchIds);
+	std::vector<std::uint32_t>().swap(batchHashes);
+	std::vector<Index>().swap(batchPoints);
 
+	// The queries only need the id and row of an edge, which both arcs have
+	large_vector<Arc> rows;
+	rows.reserve(arcs.size() / 2);
+	for (Index a = 0; a < arcs.size(); a += 2) rows.push_back(std::move(arcs[a]));
+	arcs.swap(rows);
+	for (Index &a : blockEdges) a /= 2;
+	points.shrink_to_fit();
+
+#ifdef __GLIBC__
+	// The ids of the dropped arcs are scattered over the heap
+	malloc_trim(0);
+#endif
+	compactTime.report();
 }
 
 void Network::constructBCTree() {
-	for (auto pi : pointMap) {
-		Point * const p = pi.second;
-		if (!p->visited && p->isController) {
+	blockEdges.reserve(edgeCount);
+	blockPoints.reserve(2 * static_cast<size_t>(edgeCount));
+	if (usePeeling) peelTrees();
+	if (useChainContraction) contractChains();
+	for (Index p = 0; p < points.size(); ++p) {
+		if (!pointState[p].visited && pointState[p].isController) {
 			time = 0;
 			constructBCTree(p);
 			if (!bcStack.empty()) {
-				Point *from = get<0>(bcStack[0]);
-				Point *to = get<1>(bcStack[0])->to;
+				const Index from = get<0>(bcStack[0]);
+				const Index to = arcs[get<1>(bcStack[0])].to;
 				bcRoots.push_back(unwindBlock(from, to)); // , true));
 			}
 		}
 	}
+	if (useChainContraction) restoreChains();
+	if (usePeeling) attachTrees();
+	layoutBCTree();
 }
 
-void Network::constructBCTree(Point *p) {
-	p->visited = true;
-	p->time = p->low = time++;
+// Nothing is added to pointState during the DFS, so references to it stay valid;
+// nodes grow, so they are looked up again after every makeNode.
+void Network::constructBCTree(Index p) {
+	PointState &point = pointState[p];
+	point.visited = true;
+	point.time = point.low = time++;
+	if (point.cutByTrees) makeArticulation(p);
 	int childCount = 0;
-	for (Arc *a : p->arcs) {
-		Point *n = a->to;
-		if (!n->visited) {
+	const Index first = point.firstArc, last = first + point.arcCount;
+	for (Index i = first; i < last; ++i) {
+		const Index a = adjacency[i];
+		const Index n = adjacentPoints[i];
+		PointState &next = pointState[n];
+		if (!next.visited) {
 			bcStack.push_back(make_tuple( p, a ));
 			++childCount;
-			n->dfsParent = p;
+			next.dfsParent = p;
 			constructBCTree(n);
-			p->low = min(p->low, n->low);
-			if ( (p->time>0 && n->low >= p->time) || (p->dfsParent==nullptr && childCount>1) ) {
-				if (p->articulation == nullptr) {
-					p->articulation = new(nodePool.malloc()) BCNode;
-					p->articulation->points.push_back(p);
-					if (p->isController) {
-						p->articulation->hasController = true;
-						controllerNodes.push_back(p->articulation);
-					}
-					if (p->isStart) {
-						p->articulation->hasStart = true;
-						startNodes.push_back(p->articulation);
-					}
-				}
-				BCNode *block = unwindBlock(p,n);
-				BCNode::connect(p->articulation, block);
+			point.low = min(point.low, next.low);
+			if ( (point.time>0 && next.low >= point.time) || (point.dfsParent==NoIndex && childCount>1) ) {
+				makeArticulation(p);
+				unwindBlock(p,n); // also connects the block to point.articulation
 			}
 		}
-		else if (n != p->dfsParent && n->time<p->time) {
+		else if (n != point.dfsParent && next.time<point.time) {
 			bcStack.push_back(make_tuple( p, a ));
-			p->low = n->time;
+			point.low = min(point.low, next.time);
 		}
 	}
 }
 
-BCNode *Network::unwindBlock(Point *p, Point *n ) { //, bool flush) {
-	BCNode *block = new(nodePool.malloc()) BCNode;
-	while ( !bcStack.empty() && ( get<0>(bcStack.back()) != p || get<1>(bcStack.back())->to != n) ) {
+void Network::makeArticulation(Index p) {
+	PointState &point = pointState[p];
+	if (point.articulation != NoIndex) return;
+	const Index cut = makeNode();
+	point.articulation = cut;
+	addPoint(cut, p);
+	if (point.isController) {
+		nodes[cut].hasController = true;
+		controllerNodes.push_back(cut);
+	}
+	if (point.isStart) {
+		nodes[cut].hasStart = true;
+		startNodes.push_back(cut);
+	}
+}
+
+Index Network::makeNode() {
+	const Index v = static_cast<Index>(nodes.size());
+	nodes.emplace_back();
+	nodes.back().firstPoint = static_cast<int>(blockPoints.size());
+	nodes.back().firstEdge = static_cast<int>(blockEdges.size());
+	return v;
+}
+
+Index Network::unwindBlock(Index p, Index n ) { //, bool flush) {
+	// A contracted chain on its own is a path of bridges;
+	// unwind all but the first, which is left on the stack.
+	if (!bcStack.empty() && get<0>(bcStack.back()) == p) {
+		const Index top = get<1>(bcStack.back());
+		if (arcs[top].to == n && arcs[top].isChain) {
+			unwindChain(p, top);
+			n = arcs[chainedArcs[chains[top - firstChainArc].first]].to;
+		}
+	}
+
+	const Index block = makeNode();
+	while ( !bcStack.empty() && ( get<0>(bcStack.back()) != p || arcs[get<1>(bcStack.back())].to != n) ) {
 		popFrame(p, block);
 	}
 	if (!bcStack.empty()) {
 		popFrame(p, block);
 	}
 	
-	block->points.push_back(p);
-	if (p->articulation == nullptr && !block->hasController && p->isController) {
-		block->hasController = true;
+	addPoint(block, p);
+	PointState &point = pointState[p];
+	BCNode &b = nodes[block];
+	if (point.articulation == NoIndex && point.block != block) {
+		point.block = block;
+		++b.pointCount;
+	}
+	if (point.articulation == NoIndex && !b.hasController && point.isController) {
+		b.hasController = true;
 		controllerNodes.push_back(block);
 	}
-	if (p->articulation == nullptr && !block->hasStart && p->isStart) {
-		block->hasStart = true;
+	if (point.articulation == NoIndex && !b.hasStart && point.isStart) {
+		b.hasStart = true;
 		startNodes.push_back(block);
 	}
 
-	if (p->articulation) {
-		BCNode::connect(p->articulation, block);
+	if (point.articulation != NoIndex) {
+		connect(point.articulation, block);
+	}
+
+	if (b.isBridge()) {
+		b.pointCount = 0;
+		for (Index q : nodePoints(b)) {
+			const PointState &end = pointState[q];
+			if (end.articulation == NoIndex && (end.isController || end.isStart)) ++b.pointCount;
+		}
 	}
 
 	return block;
 }
 
-void Network::popFrame( Point *p, BCNode *block ) {
-	//Point *from = get<0>(bcStack.back());
-	Arc *arc = get<1>(bcStack.back());
-	if (!block->hasStart && arc->isStart) {
-		block->hasStart = true;
+void Network::popFrame( Index p, Index block ) {
+	//Index from = get<0>(bcStack.back());
+	const Index a = get<1>(bcStack.back());
+	if (arcs[a].isChain) {
+		const Chain &chain = chains[a - firstChainArc];
+		for (Index i = 0; i < chain.count; ++i) {
+			addToBlock(p, block, chainedArcs[chain.first + i]);
+		}
+	}
+	else {
+		addToBlock(p, block, a);
+	}
+	bcStack.pop_back();
+}
+
+void Network::addToBlock( Index p, Index block, Index a ) {
+	const Arc &arc = arcs[a];
+	BCNode &b = nodes[block];
+	if (!b.hasStart && arc.isStart) {
+		b.hasStart = true;
 		startNodes.push_back(block);
 	}
-	block->points.push_back(arc->to);
-	block->edges.push_back(arc->id);
-	BCNode *toArticulation = arc->to->articulation;
-	if (toArticulation == nullptr) {
-		if (!block->hasController && arc->to->isController) {
-			block->hasController = true;
+	addPoint(block, arc.to);
+	blockEdges.push_back(a);
+	++b.edgesSize;
+	PointState &to = pointState[arc.to];
+	const Index toArticulation = to.articulation;
+	if (toArticulation == NoIndex) {
+		if (to.block != block) {
+			to.block = block;
+			++b.pointCount;
+		}
+		if (!b.hasController && to.isController) {
+			b.hasController = true;
 			controllerNodes.push_back(block);
 		}
-		if (!block->hasStart && arc->to->isStart) {
-			block->hasStart = true;
+		if (!b.hasStart && to.isStart) {
+			b.hasStart = true;
 			startNodes.push_back(block);
 		}
 	}
-	if (toArticulation && (p == nullptr || toArticulation != p->articulation)) {
-		BCNode::connect(block, toArticulation);
+	if (toArticulation != NoIndex && (p == NoIndex || toArticulation != pointState[p].articulation)) {
+		connect(block, toArticulation);
 	}
-	bcStack.pop_back();
 }
 
-void Network::markTowardController(BCNode *v, BCNode *parent) noexcept {
-	for (auto &n : v->neighbors) {
-		//assert( n.to->neighbors[n.reverseIndex].to == v );
+void Network::markTowardController(Index v, Index parent) noexcept {
+	for (const auto &n : nodeNeighbors(nodes[v])) {
+		//assert( neighbors[n.reverse].to == v );
 		if (n.to != parent) {
-			BCNode::Neighbor &reverse = n.to->neighbors[n.reverseIndex];
+			BCNode::Neighbor &reverse = neighbors[n.reverse];
 			if (!reverse.marked) {
 				reverse.marked = true;
 				markTowardController(n.to, v);
@@ -174,21 +347,99 @@ void Network::markTowardController(BCNode *v, BCNode *parent) noexcept {
 	}
 }
 
-void Network::floodFromStartnode(BCNode *v, BCNode *parent) {
-	v->visited = true;
-	if (v->points.size() == 2) {
-		for (const string &s : v->edges) *outstream << s << '\n';
-		if (v->points[0]->isController) *outstream << v->points[0]->id << '\n';
-		if (v->points[1]->isController) *outstream << v->points[1]->id << '\n';
-		if (v->points[0]->isStart) *outstream << v->points[0]->id << '\n';
-		if (v->points[1]->isStart) *outstream << v->points[1]->id << '\n';
-	} else {
-		for (const string &s : v->edges) *outstream << s << '\n';
-		for (Point * const p : v->points) *outstream << p->id << '\n';
+// Nodes, their contents and neighbors in preorder from the controllers,
+// keeping the order of the neighbors of every node.
+void Network::layoutBCTree() {
+	// Neighbors in the order the nodes were made, as (to, position of the reverse)
+	const Index n = static_cast<Index>(nodes.size());
+	vector<Index> first(n + 1, 0);
+	for (const auto &e : treeEdges) {
+		++first[get<0>(e) + 1];
+		++first[get<1>(e) + 1];
+	}
+	for (Index v = 0; v < n; ++v) first[v + 1] += first[v];
+	vector<tuple<Index, Index>> made(2 * treeEdges.size());
+	vector<Index> fill(first.begin(), first.end() - 1);
+	for (const auto &e : treeEdges) {
+		const Index a = get<0>(e), b = get<1>(e);
+		const Index ab = fill[a]++, ba = fill[b]++;
+		made[ab] = make_tuple(b, ba);
+		made[ba] = make_tuple(a, ab);
+	}
+	treeEdges.clear();
+	treeEdges.shrink_to_fit();
+
+	// Preorder; nodes that no controller reaches go last, but there are none
+	vector<Index> order, newIndex(n, NoIndex), stack;
+	order.reserve(n);
+	for (Index c : controllerNodes) {
+		if (newIndex[c] != NoIndex) continue;
+		stack.push_back(c);
+		while (!stack.empty()) {
+			const Index v = stack.back();
+			stack.pop_back();
+			if (newIndex[v] != NoIndex) continue;
+			newIndex[v] = static_cast<Index>(order.size());
+			order.push_back(v);
+			// Reversed, so that they come off the stack in order
+			for (Index i = first[v + 1]; i > first[v]; --i) {
+				if (newIndex[get<0>(made[i - 1])] == NoIndex) stack.push_back(get<0>(made[i - 1]));
+			}
+		}
 	}
-	for (auto &n : v->neighbors) {
-		if (n.to != parent && n.marked && !n.to->visited) {
-			floodFromStartnode(n.to, v);
+	for (Index v = 0; v < n; ++v) {
+		if (newIndex[v] == NoIndex) {
+			newIndex[v] = static_cast<Index>(order.size());
+			order.push_back(v);
 		}
 	}
+
+	// Everything in the new order
+	large_vector<BCNode> newNodes;
+	large_vector<Index> newPoints, newEdges;
+	newNodes.reserve(n);
+	newPoints.reserve(blockPoints.size());
+	newEdges.reserve(blockEdges.size());
+	Index firstNeighbor = 0;
+	for (Index v : order) {
+		newNodes.push_back(nodes[v]);
+		BCNode &node = newNodes.back();
+		const ContentRange<const Index> ps = nodePoints(node), es = nodeEdges(node);
+		node.firstPoint = static_cast<int>(newPoints.size());
+		node.firstEdge = static_cast<int>(newEdges.size());
+		newPoints.insert(newPoints.end(), ps.begin(), ps.end());
+		newEdges.insert(newEdges.end(), es.begin(), es.end());
+		node.firstNeighbor = firstNeighbor;
+		node.neighborCount = first[v + 1] - first[v];
+		firstNeighbor += node.neighborCount;
+	}
+	neighbors.resize(made.size());
+	for (Index v = 0; v < n; ++v) {
+		const BCNode &node = newNodes[newIndex[v]];
+		for (Index i = 0; i < node.neighborCount; ++i) {
+			const Index to = get<0>(made[first[v] + i]);
+			const Index reverse = get<1>(made[first[v] + i]);
+			// The reverse is at the same offset among the neighbors of to
+			const Index reverseOffset = reverse - first[to];
+			neighbors[node.firstNeighbor + i] = { newIndex[to], newNodes[newIndex[to]].firstNeighbor + reverseOffset, 0 };
+		}
+	}
+	nodes.swap(newNodes);
+	blockPoints.swap(newPoints);
+	blockEdges.swap(newEdges);
+
+	// And everything that refers to nodes. From here on the queries
+	// find points in the tree through pointTree, not pointState.
+	pointTree.resize(pointState.size());
+	for (Index p = 0; p < pointState.size(); ++p) {
+		const PointState &point = pointState[p];
+		PointInTree &inTree = pointTree[p];
+		if (point.articulation != NoIndex) inTree.articulation = newIndex[point.articulation];
+		if (point.block != NoIndex) inTree.block = newIndex[point.block];
+		inTree.isController = point.isController;
+		inTree.isStart = point.isStart;
+	}
+	for (Index &v : controllerNodes) v = newIndex[v];
+	for (Index &v : startNodes) v = newIndex[v];
+	for (Index &v : bcRoots) v = newIndex[v];
 }
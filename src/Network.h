@@ -12,13 +12,27 @@
 #include <memory>
 #include <tuple>
 
-#include <boost/pool/object_pool.hpp>
-
 #include "Settings.h"
 
 #include "Point.h"
 #include "Arc.h"
 #include "BCNode.h"
+#include "Sink.h"
+#include "UpstreamIterator.h"
+#include "Pipeline.h"
+
+// Number of distinct upstream features. Edges are counted per row,
+// so an edge id that occurs in several rows may count more than once.
+struct UpstreamCount {
+	size_t points{ 0 };
+	size_t edges{ 0 };
+};
+
+// A piece of text that is not owned: size bytes at data.
+struct TextRange {
+	const char *data;
+	size_t size;
+};
 
 // Replace here if you want to use a different hash function
 // for vertex and edge id strings.
@@ -35,6 +49,43 @@ public:
 	// Calculate upstream features and write to result stream
 	void enumerateUpstreamFeatures( std::ostream *result_stream);
 
+	// Calculate upstream features and hand them to a sink (see Sink.h)
+	template< typename Sink > void enumerateUpstreamFeatures(Sink &sink);
+
+	// Calculate upstream features of the given start points and edges, instead of
+	// the ones from the starting points file, and hand them to a sink.
+	// Can be called any number of times.
+	template< typename Sink > void enumerateUpstreamFeatures(const std::vector<std::string> &startIds, Sink &sink);
+
+	// Count the upstream features from precomputed node sizes, without
+	// producing any ids. Same start points as the above methods.
+	UpstreamCount countUpstreamFeatures();
+	UpstreamCount countUpstreamFeatures(const std::vector<std::string> &startIds);
+
+	// Is the point or edge featureId upstream of the start point or edge startId?
+	// Answered from an Euler tour of the block-cut tree without enumerating
+	// anything, in constant time after looking up the two ids.
+	bool isUpstream(const std::string &featureId, const std::string &startId);
+
+	// Upstream features of the given start ids as pieces of text, one id per line.
+	// Every piece is a range of pre-rendered block contents or a single start id,
+	// and there are O(log n) of them per start; the first call renders all blocks.
+	// The pieces are valid until the Network is destructed.
+	void upstreamText(const std::vector<std::string> &startIds, std::vector<TextRange> &pieces);
+
+	// Lazily enumerate upstream feature ids (see UpstreamIterator.h)
+	UpstreamRange upstreamFeatures() { return UpstreamRange(this); }
+
+	// Build the block-cut tree and mark it toward the controllers.
+	// Called by the above; does nothing if already done.
+	void buildIndex();
+
+	// Build the index, then free everything that is only needed to build it:
+	// the state of the DFS, the arcs grouped by point, the starting ids and
+	// one of the two arcs of every row. All queries work as before.
+	// For long-running processes; does nothing if already done.
+	void compact();
+
 	// === Constructing the network ======================
 	
 	// You should default-construct the Network and load a network using the load method.
@@ -44,70 +95,355 @@ public:
 	Network(const Network&) = delete;
 	Network &operator=(const Network&) = delete;
 
-	// Create an edge
+	// Create an edge; finish_load groups the arcs by point afterwards
 	void addEdge(const std::string &fromId, const std::string &toId, const std::string &viaId);
+	// Create the edges of a batch of rows (see Pipeline.h), in order. Looks up
+	// the ids of RowBatch::Rows rows at a time, prefetching the table ahead.
+	void addEdges(const RowBatch &batch);
+	// Same, given the points: rowPoints[2r] is the from point of row r, and
+	// rowPoints[2r+1] its to point.
+	void addEdges(const RowBatch &batch, const Index *rowPoints);
+	// Same for the count rows from row first on, whose points start at rowPoints
+	void addEdges(const RowBatch &batch, size_t first, size_t count, const Index *rowPoints);
+	// Create the edges of all these rows, in order, resolving their ids by
+	// sorting them instead of looking each up (see Network_sorted.cpp). For a
+	// network without points yet; otherwise the same as addEdges on each.
+	// False, with a message, if the points did not come out distinct.
+	bool addEdgesSorted(std::vector<RowBatch> &batches);
 
 	// === Loading instances from file ===================
+	// All load methods return false if the network could not be loaded.
+	// The starting points file may be empty (""), for example if you
+	// only want to ask for start points later with a query.
+	// Network files may be gzip- or zstd-compressed, see ChunkReader.h, and may
+	// be pipes; "-" reads the network from standard input.
 	
+	// Parse uncompressed json files in the pipeline of load_stream as well.
+	// Off by default: it only pays off with a core for each stage, see README.
+	bool usePipeline{ false };
+
+	// Let load and load_lines resolve the ids with addEdgesSorted, after
+	// parsing all rows. Off by default: it only pays off on several cores.
+	bool sortIds{ false };
+
+	// Number of parts load_lines splits the file into, each parsed by a
+	// thread, and of threads for addEdgesSorted. 0 means one per core, but no
+	// more than a part per megabyte; other numbers are used as given, also
+	// for small files (for testing).
+	unsigned loadThreads{ 0 };
+
+	// Let the threads of load_lines number the ids themselves, in a
+	// ConcurrentInterner (see Interner.h), instead of looking them up one by
+	// one after parsing. Off by default: it only pays off on several cores.
+	bool internIds{ false };
+
 	// Properly load network using RapidJSON to actually parse the json.
 	// Gives parse errors on invalid json.
 	// This is the recommended load method.
-	void load(const std::string &network_filename, const std::string &starting_filename);
+	// Compressed files and pipes (and others if usePipeline is set) are parsed
+	// as they are read, by a pipeline of threads; see load_stream.
+	bool load(const std::string &network_filename, const std::string &starting_filename);
 
 	// (Usually) faster way to load a network: does not validate the json and ignores the structure.
 	// Assumes rows are given by viaGlobalId, fromGlobalId and toGlobalId in that order,
 	//     and those strings do not otherwise occur in the file.
 	// Assumes any controllers are after the last row, and nothing else is called globalId.
 	// Fails silently if its assumptions do not hold; use only when you know they do.
-	void load_quick(const std::string &network_filename, const std::string &starting_filename);
+	bool load_quick(const std::string &network_filename, const std::string &starting_filename);
 
 	// Inappropriately "optimized" parser. Even faster than load_quick, but very dirty and will
 	//     be hard to debug if it does not like your file.
 	// Among other things, assumes all identifiers are 38 characters long.
 	// Do not use, except possibly for fun.
-	void load_dirty(const std::string &network_filename, const std::string &starting_filename);
+	bool load_dirty(const std::string &network_filename, const std::string &starting_filename);
+
+	// Rows one per line, either as NDJSON objects with viaGlobalId, fromGlobalId
+	// and toGlobalId, or as CSV via,from,to (with a header if the first field
+	// is "via" or "viaGlobalId"); the first character decides. The controller
+	// ids are in a separate file, separated by white space. Several threads
+	// parse the lines at once, each taking a part of the file (mapped to
+	// memory where possible); the rows are then added in the order of the
+	// file, so the result is the same as for the equivalent json.
+	bool load_lines(const std::string &network_filename, const std::string &controllers_filename, const std::string &starting_filename);
+
+	// Binary network, see BinaryNetwork.h; load recognises it by its first bytes,
+	// also from pipes and compressed files. The file is mapped to memory where
+	// possible and used as it is, without parsing any text.
+	bool load_binary(const std::string &network_filename, const std::string &starting_filename);
+
+	// Write the network in the binary format, to be loaded by load_binary.
+	// Only before the index is built, which reorders and drops arcs.
+	bool save_binary(const std::string &filename) const;
 
 	// Helper
-	std::unique_ptr<char[]> setup_load(const std::string &network_filename, const std::string &starting_filename);
-	std::unique_ptr<char[]> setup_load(const std::string &network_filename, const std::string &starting_filename, int &buffer_length);
+	bool load_stream(const std::string &network_filename, const std::string &starting_filename);
+	bool load_binary(const char *data, size_t size, const std::string &network_filename);
+	bool read_starting_points(const std::string &starting_filename);
+	LargeBuffer setup_load(const std::string &network_filename, const std::string &starting_filename);
+	LargeBuffer setup_load(const std::string &network_filename, const std::string &starting_filename, int &buffer_length);
+	LargeBuffer read_network(const std::string &network_filename, size_t &length);
 	void finish_load();
-	Point *getOrMake(const std::string &id);
+	void buildAdjacency();
+	Index getOrMake(const std::string &id);
+	Index getOrMake(const std::string &id, std::uint32_t hash);
 
 	// === Internal structure of the network =============
-	// Memory pools.
-	// Allocate all points, arcs and nodes using these; they will not be destructed.
-	// Memory is freed when the network is destructed;
-	boost::object_pool<BCNode> nodePool;
-	boost::object_pool<Point> pointPool;
-	boost::object_pool<Arc> arcPool;
+	// Points, arcs and block-cut tree nodes, referring to each other by
+	// Index instead of by pointer. Arcs 2r and 2r+1 are the two directions
+	// of row r, until compact() keeps only arc 2r, as arc r. Nothing is
+	// added to points and arcs after loading, so pointers to them (as
+	// handed to sinks) stay valid until then.
+	large_vector<Point> points;
+	large_vector<PointState> pointState; // by point, see Point.h; until compact()
+	large_vector<PointInTree> pointTree; // by point, see Point.h
+	large_vector<Arc> arcs;
+	large_vector<BCNode> nodes;
 
-	// Points of the network
-	std::unordered_map<std::string, Point*, IdHasher> pointMap;
+	// The arcs leaving each point, grouped by point; see PointState::firstArc.
+	// Their targets are repeated alongside, so the DFS need not look at the arcs.
+	large_vector<Index> adjacency;
+	large_vector<Index> adjacentPoints; // arcs[adjacency[i]].to
+	ContentRange<const Index> pointArcs(Index p) const noexcept {
+		return ContentRange<const Index>(adjacency.data() + pointState[p].firstArc, pointState[p].arcCount);
+	}
+
+	// Points of the network by id: an open-addressing hash table with linear
+	// probing, holding point indices. The ids are only stored in points, and
+	// the table is one array, at most half full, so there is nothing to free
+	// per point when the Network is destructed.
+	struct PointSlot {
+		std::uint32_t hash; // of the id, by IdHasher
+		Index point;        // NoIndex if the slot is empty
+	};
+	large_vector<PointSlot> pointTable;
+	static std::uint32_t hashId(const std::string &id) noexcept { return static_cast<std::uint32_t>(IdHasher()(id)); }
+	size_t findSlot(const std::string &id, std::uint32_t hash) const noexcept;
+	void growPointTable();
+	bool fillPointTable();
+	// Scratch space of addEdges: the point ids of RowBatch::Rows rows, their
+	// hashes and points; freed by finish_load
+	std::vector<std::string> batchIds;
+	std::vector<std::uint32_t> batchHashes;
+	std::vector<Index> batchPoints;
 
 	// Upstream instance information and BC-tree
 	std::unordered_set<std::string> startingIds;
 
-	// Output stream
-	std::ostream *outstream{ 0 };
+	// Number of edges (rows) added so far
+	Index edgeCount{ 0 };
 
 	// === Block-Cut Tree ================================
 	// Algorithm based on Hopcroft-Tarjan.
 	void constructBCTree();
-	void constructBCTree(Point *p);
-	BCNode *unwindBlock(Point *p, Point *n); // , bool flush = false);
-	void popFrame(Point *p, BCNode *block);
-	std::vector<std::tuple<Point*,Arc*>> bcStack;
+	void constructBCTree(Index p);
+	Index unwindBlock(Index p, Index n); // , bool flush = false);
+	void popFrame(Index p, Index block);
+	void addToBlock(Index p, Index block, Index arc);
+	void makeArticulation(Index p);
+	Index makeNode();
+	std::vector<std::tuple<Index,Index>> bcStack; // point, arc
 	int time{ 0 };
-	std::vector<BCNode*> controllerNodes;
-	std::vector<BCNode*> startNodes;
-	std::vector<BCNode*> bcRoots;
+	std::vector<Index> controllerNodes;
+	std::vector<Index> startNodes;
+	std::vector<Index> bcRoots;
+	bool indexed{ false };
+	bool compacted{ false };
+
+	// Contents of all nodes, back to back in the order they are made.
+	// A node is filled completely before the next is made.
+	large_vector<Index> blockPoints;
+	large_vector<Index> blockEdges; // arcs
+	void addPoint(Index v, Index p) {
+		blockPoints.push_back(p);
+		++nodes[v].pointsSize;
+	}
+	ContentRange<const Index> nodePoints(const BCNode &v) const noexcept {
+		return ContentRange<const Index>(blockPoints.data() + v.firstPoint, v.pointsSize);
+	}
+	ContentRange<const Index> nodeEdges(const BCNode &v) const noexcept {
+		return ContentRange<const Index>(blockEdges.data() + v.firstEdge, v.edgesSize);
+	}
+
+	// Edges of the tree are only collected while it is built. Afterwards, the
+	// nodes are put in depth-first order from the controllers, with their
+	// contents and neighbors in the same order, so that marking and flooding
+	// go through memory more or less in order.
+	void connect(Index a, Index b) { treeEdges.push_back(std::make_tuple(a, b)); }
+	void layoutBCTree();
+	std::vector<std::tuple<Index, Index>> treeEdges;
+	large_vector<BCNode::Neighbor> neighbors;
+	ContentRange<BCNode::Neighbor> nodeNeighbors(const BCNode &v) noexcept {
+		return ContentRange<BCNode::Neighbor>(neighbors.data() + v.firstNeighbor, static_cast<int>(v.neighborCount));
+	}
+	ContentRange<const BCNode::Neighbor> nodeNeighbors(const BCNode &v) const noexcept {
+		return ContentRange<const BCNode::Neighbor>(neighbors.data() + v.firstNeighbor, static_cast<int>(v.neighborCount));
+	}
+	// ===================================================
+
+	// === Relabeling for locality =======================
+	// Before anything else, points are renumbered in BFS, reverse Cuthill-McKee
+	// or DFS order from the controllers, and rows are put in the order of their
+	// later point, so that points and arcs that the DFS visits one after the other
+	// are close in memory. Point::index is the new number; Arc::index stays the
+	// row in the file. Off by default, see README.
+	enum class Relabeling { None, BFS, RCM, DFS };
+	Relabeling relabeling{ Relabeling::None };
+	void relabel();
+	void relabelingOrder(std::vector<Index> &order) const;
+	// ===================================================
+
+	// === Peeling hanging trees =========================
+	// Before the DFS, the trees hanging off the 2-core are peeled with a
+	// queue of degree-1 points, and the arcs into them are taken out of the
+	// core. Every tree edge is a bridge, so after the DFS the trees are
+	// attached top-down as bridges without any lowpoint bookkeeping.
+	// Controllers are never peeled, so every component keeps its DFS root.
+	// Off by default: building the bridges costs the same either way, so
+	// the peeling itself is overhead, see README.
+	bool usePeeling{ false };
+	void peelTrees();
+	void attachTrees();
+	std::vector<std::tuple<Index,Index>> treeArcs; // core point, arc to a peeled tree
+	// ===================================================
+
+	// === Chain contraction =============================
+	// Before the DFS, every maximal chain of degree-2 points (that are not
+	// controllers or starts) is replaced by a chain arc between its ends, in the
+	// arcs of both ends. Blocks get the original points and edges back when
+	// they are unwound; a chain that is a block by itself becomes its original
+	// path of bridges and cut nodes. The arcs are restored after the DFS.
+	// Off by default: walking the chains costs about as much as the DFS
+	// steps it saves, see README.
+	bool useChainContraction{ false };
+	void contractChains();
+	void restoreChains();
+	bool isChainInterior(Index p) const noexcept;
+	void unwindChain(Index p, Index chainArc);
+	struct Chain {
+		Index first, count; // range in chainedArcs, in order along the chain
+	};
+	Index firstChainArc{ 0 }; // arcs from here on are chain arcs
+	std::vector<Chain> chains; // of arc firstChainArc + i
+	std::vector<Index> chainedArcs; // the original arcs of all chains, back to back
+	std::vector<std::tuple<Index, Index>> contractedArcs; // position in adjacency, original arc
+	// ===================================================
+
+	// === Looking up features by id ====================
+	// Points are found through pointTable; edges through edgeNodes, which is
+	// only filled (by indexEdges) once somebody asks for an edge.
+	Index findPoint(const std::string &id) const;
+	void findNodes(const std::string &id, std::vector<Index> &found);
+	void indexEdges();
+	void indexEdges(Index v, Index parent);
+	std::unordered_multimap<std::string, Index, IdHasher> edgeNodes;
+	bool edgesIndexed{ false };
+	// ===================================================
+
+	// === Euler tour and heavy-light decomposition ======
+	// Every tree of the block-cut forest is rooted at one of its controller
+	// nodes. Then the upstream nodes of s are its ancestors, which lead to the
+	// root controller, together with the core nodes: those that lie on paths
+	// between controllers and are therefore on the way to some controller.
+	// The tour visits the child with the largest subtree first, so that
+	// every heavy path is a contiguous range of tour positions.
+	void tourBCTree();
+	int sizeBCTree(Index v, Index parent, int component);
+	void tourBCTree(Index v, Index head);
+	bool onUpstreamPath(const BCNode &v, const BCNode &s) const noexcept;
+	std::vector<Index> tourOrder; // nodes by tin
+	std::vector<Index> componentRoots;
+	bool toured{ false };
+
+	// Text output of all nodes in tour order; node v is at
+	// rendered[renderedOffset[v->tin] .. renderedOffset[v->tin + 1]).
+	// The core of every tree is cached as a list of ranges.
+	void renderBCTree();
+	void addRange(std::vector<TextRange> &ranges, int firstTin, int lastTin) const;
+	std::string rendered;
+	std::vector<size_t> renderedOffset;
+	std::vector<std::vector<TextRange>> coreRanges; // by component
+	bool renderedIndex{ false };
 	// ===================================================
 
 	// === Upstream features on block-cut tree ===========
-	void markTowardController(BCNode *v, BCNode *parent) noexcept;
-	void floodFromStartnode(BCNode *v, BCNode *parent);
+	// A node is visited in the current enumeration iff its visited == epoch.
+	unsigned epoch{ 0 };
+	void markTowardController(Index v, Index parent) noexcept;
+	template< typename Sink > void floodFromStartnode(Index v, Index parent, Sink &sink);
+	template< typename Sink > void outputContents(const BCNode &v, Sink &sink);
+	void countFromStartnode(Index v, Index parent, UpstreamCount &count) noexcept;
 	// ===================================================
 
 };
 
+// === Implementation of templates ===================
+
+#include "Log.h"
+#include "Timer.h"
+
+template< typename Sink >
+void Network::enumerateUpstreamFeatures(Sink &sink) {
+
+	buildIndex();
+
+	log() << "Output upstream features    ... ";
+	const Timer outputTime;
+	++epoch;
+	for (Index s : startNodes) {
+		if (nodes[s].visited != epoch) {
+			floodFromStartnode(s, NoIndex, sink);
+		}
+	}
+	outputTime.report();
+
+}
+
+template< typename Sink >
+void Network::enumerateUpstreamFeatures(const std::vector<std::string> &startIds, Sink &sink) {
+	buildIndex();
+	++epoch;
+	std::vector<Index> found;
+	for (const std::string &id : startIds) {
+		// A start point at the end of a bridge is not output by the flood.
+		const Index p = findPoint(id);
+		if (p != NoIndex && pointTree[p].block != NoIndex && nodes[pointTree[p].block].isBridge()) {
+			sink.point(&points[p]);
+		}
+		found.clear();
+		findNodes(id, found);
+		for (Index v : found) {
+			if (nodes[v].visited != epoch) {
+				floodFromStartnode(v, NoIndex, sink);
+			}
+		}
+	}
+}
+
+template< typename Sink >
+void Network::floodFromStartnode(Index v, Index parent, Sink &sink) {
+	BCNode &node = nodes[v];
+	node.visited = epoch;
+	outputContents(node, sink);
+	for (const auto &n : nodeNeighbors(node)) {
+		if (n.to != parent && n.marked && nodes[n.to].visited != epoch) {
+			floodFromStartnode(n.to, v, sink);
+		}
+	}
+}
+
+template< typename Sink >
+void Network::outputContents(const BCNode &v, Sink &sink) {
+	for (Index a : nodeEdges(v)) sink.edge(&arcs[a]);
+	const ContentRange<const Index> ps = nodePoints(v);
+	if (v.isBridge()) {
+		const PointInTree &p0 = pointTree[ps[0]], &p1 = pointTree[ps[1]];
+		if (p0.isController) sink.point(&points[ps[0]]);
+		if (p1.isController) sink.point(&points[ps[1]]);
+		if (p0.isStart) sink.point(&points[ps[0]]);
+		if (p1.isStart) sink.point(&points[ps[1]]);
+	} else {
+		for (Index p : ps) sink.point(&points[p]);
+	}
+}
+
 #endif //ndef INCLUDED_NETWORK
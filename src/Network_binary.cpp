@@ -0,0 +1,206 @@
+// Recent Microsoft compilers *really* don't like fopen,
+// but other's don't consistently have fopen_s.
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+
+#include "Network.h"
+#include "BinaryNetwork.h"
+#include "MappedFile.h"
+
+using std::string;
+using std::uint32_t;
+using std::uint64_t;
+
+#include "Log.h"
+#include "Timer.h"
+
+//=== The format =============================================================
+
+static size_t padded(uint64_t bytes) {
+	return static_cast<size_t>((bytes + 7) & ~uint64_t(7));
+}
+
+BinaryLayout::BinaryLayout(const BinaryHeader &header) noexcept {
+	idEnd = sizeof(BinaryHeader);
+	text = idEnd + sizeof(uint64_t) * header.idCount;
+	via = text + padded(header.textSize);
+	from = via + sizeof(uint32_t) * header.rowCount;
+	to = from + sizeof(uint32_t) * header.rowCount;
+	controller = to + sizeof(uint32_t) * header.rowCount;
+	size = controller + sizeof(uint32_t) * header.controllerCount;
+}
+
+// The columns are used as they are in the file, so only where that is also
+// the byte order of the processor
+static bool littleEndian() noexcept {
+	const uint32_t one = 1;
+	unsigned char first;
+	std::memcpy(&first, &one, 1);
+	return first == 1;
+}
+
+bool isBinaryNetwork(const string &filename) {
+	FILE *fp = fopen(filename.c_str(), fopenMode);
+	if (fp == nullptr) return false;
+	char magic[sizeof BinaryMagic];
+	const bool binary = fread(magic, 1, sizeof magic, fp) == sizeof magic && std::equal(magic, magic + sizeof magic, BinaryMagic);
+	fclose(fp);
+	return binary;
+}
+
+//=== Loading ================================================================
+
+bool Network::load_binary(const string &network_filename, const string &starting_filename) {
+	const Timer loadTime;
+	log() << "Loading (binary)            ... ";
+	if (!read_starting_points(starting_filename)) return false;
+	MappedFile file;
+	if (!file.open(network_filename)) return false;
+	if (!load_binary(file.data(), file.size(), network_filename)) return false;
+	loadTime.report();
+	finish_load();
+	return true;
+}
+
+// The rows and controllers of the binary network at data, which is aligned
+// to 8 bytes; the name is for messages.
+bool Network::load_binary(const char *data, size_t size, const string &network_filename) {
+	const auto invalid = [&network_filename](const char *problem) {
+		std::cerr << "Invalid binary network file " << network_filename << ": " << problem << "\n";
+		return false;
+	};
+
+	BinaryHeader header;
+	if (size < sizeof header) return invalid("too short");
+	std::memcpy(&header, data, sizeof header);
+	if (!std::equal(header.magic, header.magic + sizeof header.magic, BinaryMagic)) return invalid("not a binary network");
+	if (!littleEndian()) return invalid("it is little-endian, and this processor is not");
+	if (header.version != BinaryVersion) return invalid("unsupported version");
+	if (header.textSize > size) return invalid("wrong size");
+	const BinaryLayout layout(header);
+	if (layout.size != size) return invalid("wrong size");
+	const uint64_t *idEnd = reinterpret_cast<const uint64_t*>(data + layout.idEnd);
+	const char *text = data + layout.text;
+	const uint32_t *viaColumn = reinterpret_cast<const uint32_t*>(data + layout.via);
+	const uint32_t *fromColumn = reinterpret_cast<const uint32_t*>(data + layout.from);
+	const uint32_t *toColumn = reinterpret_cast<const uint32_t*>(data + layout.to);
+	const uint32_t *controllerColumn = reinterpret_cast<const uint32_t*>(data + layout.controller);
+	for (uint32_t i = 0; i < header.idCount; ++i) {
+		if (idEnd[i] < (i == 0 ? 0 : idEnd[i - 1]) || idEnd[i] > header.textSize) return invalid("ids out of order");
+	}
+	const auto idOf = [idEnd, text](uint32_t i) {
+		const uint64_t begin = i == 0 ? 0 : idEnd[i - 1];
+		return string(text + begin, text + idEnd[i]);
+	};
+
+	// Number the points in order of first use, as getOrMake would
+	large_vector<Index> pointOf(header.idCount, NoIndex);
+	large_vector<uint32_t> idOfPoint;
+	const auto number = [&](uint32_t i) {
+		if (pointOf[i] == NoIndex) {
+			pointOf[i] = static_cast<Index>(idOfPoint.size());
+			idOfPoint.push_back(i);
+		}
+	};
+	for (uint32_t r = 0; r < header.rowCount; ++r) {
+		if (viaColumn[r] >= header.idCount || fromColumn[r] >= header.idCount || toColumn[r] >= header.idCount) return invalid("row refers to a missing id");
+		number(fromColumn[r]);
+		number(toColumn[r]);
+	}
+	for (uint32_t c = 0; c < header.controllerCount; ++c) {
+		if (controllerColumn[c] >= header.idCount) return invalid("controller refers to a missing id");
+		number(controllerColumn[c]);
+	}
+
+	// Points, each id hashed once and never compared unless the hashes collide
+	const size_t pointCount = idOfPoint.size();
+	points.reserve(pointCount);
+	for (Index p = 0; p < pointCount; ++p) {
+		points.emplace_back(idOf(idOfPoint[p]), p);
+	}
+	if (!fillPointTable()) return invalid("point id occurs twice");
+	pointState.resize(pointCount);
+
+	// Rows, in order
+	arcs.reserve(2 * size_t(header.rowCount));
+	for (uint32_t r = 0; r < header.rowCount; ++r) {
+		const string viaId = idOf(viaColumn[r]);
+		const bool isStart = !startingIds.empty() && startingIds.count(viaId) > 0;
+		arcs.emplace_back(pointOf[toColumn[r]], viaId, edgeCount);
+		arcs.back().isStart = isStart;
+		arcs.emplace_back(pointOf[fromColumn[r]], viaId, edgeCount);
+		arcs.back().isStart = isStart;
+		++edgeCount;
+	}
+	for (uint32_t c = 0; c < header.controllerCount; ++c) {
+		pointState[pointOf[controllerColumn[c]]].isController = true;
+	}
+	return true;
+}
+
+//=== Saving =================================================================
+
+bool Network::save_binary(const string &filename) const {
+	if (indexed) {
+		std::cerr << "Cannot save the network after building the index\n";
+		return false;
+	}
+	if (!littleEndian()) {
+		std::cerr << "Cannot save a binary network on this processor: the format is little-endian\n";
+		return false;
+	}
+
+	// The dictionary has the points in order, then the ids of the rows
+	std::vector<uint64_t> idEnd;
+	string text;
+	for (const Point &p : points) {
+		text += p.id;
+		idEnd.push_back(text.size());
+	}
+	std::unordered_map<string, uint32_t> viaIndex;
+	std::vector<uint32_t> via, from, to;
+	for (size_t a = 0; a < arcs.size(); a += 2) {
+		const auto entry = viaIndex.emplace(arcs[a].id, static_cast<uint32_t>(idEnd.size()));
+		if (entry.second) {
+			text += arcs[a].id;
+			idEnd.push_back(text.size());
+		}
+		via.push_back(entry.first->second);
+		from.push_back(arcs[a + 1].to);
+		to.push_back(arcs[a].to);
+	}
+	std::vector<uint32_t> controllers;
+	for (Index p = 0; p < pointState.size(); ++p) {
+		if (pointState[p].isController) controllers.push_back(p);
+	}
+
+	BinaryHeader header;
+	std::copy(BinaryMagic, BinaryMagic + sizeof BinaryMagic, header.magic);
+	header.version = BinaryVersion;
+	header.idCount = static_cast<uint32_t>(idEnd.size());
+	header.rowCount = static_cast<uint32_t>(via.size());
+	header.controllerCount = static_cast<uint32_t>(controllers.size());
+	header.textSize = text.size();
+	text.resize(padded(text.size()), '\0');
+
+	FILE *fp = fopen(filename.c_str(), "wb");
+	if (fp == nullptr) {
+		std::cerr << "Cannot open binary network file " << filename << "\n";
+		return false;
+	}
+	fwrite(&header, sizeof header, 1, fp);
+	fwrite(idEnd.data(), sizeof(uint64_t), idEnd.size(), fp);
+	fwrite(text.data(), 1, text.size(), fp);
+	for (const std::vector<uint32_t> *column : { &via, &from, &to, &controllers }) {
+		fwrite(column->data(), sizeof(uint32_t), column->size(), fp);
+	}
+	const bool failed = ferror(fp) != 0;
+	if (fclose(fp) != 0 || failed) {
+		std::cerr << "Cannot write binary network file " << filename << "\n";
+		return false;
+	}
+	return true;
+}
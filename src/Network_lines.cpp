@@ -0,0 +1,270 @@
+// Loading networks with one row per line: NDJSON or CSV
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+#include "Network.h"
+#include "MappedFile.h"
+#include "Interner.h"
+
+using std::string;
+
+#include "Log.h"
+#include "Timer.h"
+
+#include "rapidjson.h"
+#include "rapidjson/memorystream.h"
+#include "rapidjson/error/en.h"
+
+//=== Parsing a part of the file =============================================
+
+// The rows of a part of the file, as parsed by one thread
+struct LinePart {
+	const char *begin, *end;
+	RowBatch rows;
+	std::vector<Index> points; // of the from and to ids of rows, if interned
+	size_t lines{ 0 };
+	size_t errorLine{ 0 }; // of the first error, counted in this part; 0 if none
+	string error;
+
+	void addId(const char *id, size_t length) { rows.addId(id, length); }
+	bool fail(const string &message) {
+		errorLine = lines;
+		error = message;
+		return false;
+	}
+};
+
+// The three ids of a row as a json object on one line
+class RowHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, RowHandler> {
+public:
+	string id[3]; // via, from, to
+	unsigned found{ 0 };
+
+	bool StartObject() { ++depth; return Default(); }
+	bool StartArray() { ++depth; return Default(); }
+	bool EndObject(rapidjson::SizeType) { --depth; return Default(); }
+	bool EndArray(rapidjson::SizeType) { --depth; return Default(); }
+	bool Key(const char *str, rapidjson::SizeType length, bool) {
+		const auto is = [str, length](const char *key) { return std::strlen(key) == length && std::memcmp(str, key, length) == 0; };
+		field = -1;
+		if (depth == 1) {
+			if (is("viaGlobalId")) field = 0;
+			else if (is("fromGlobalId")) field = 1;
+			else if (is("toGlobalId")) field = 2;
+		}
+		return true;
+	}
+	bool String(const char *str, rapidjson::SizeType length, bool) {
+		if (field >= 0) {
+			id[field].assign(str, length);
+			found |= 1u << field;
+		}
+		return Default();
+	}
+	bool Default() {
+		field = -1;
+		return true;
+	}
+	void reset() {
+		depth = 0;
+		field = -1;
+		found = 0;
+	}
+private:
+	int depth{ 0 };
+	int field{ -1 };
+};
+
+static bool parseJsonLine(const char *begin, const char *end, LinePart &part, rapidjson::Reader &parser, RowHandler &handler) {
+	handler.reset();
+	rapidjson::MemoryStream stream(begin, end - begin);
+	parser.Parse<rapidjson::kParseNumbersAsStringsFlag>(stream, handler);
+	if (parser.HasParseError()) {
+		return part.fail(string("JSON parse error (offset ") + std::to_string(parser.GetErrorOffset()) + "): " + GetParseError_En(parser.GetParseErrorCode()));
+	}
+	if (handler.found != 7) return part.fail("Row without viaGlobalId, fromGlobalId or toGlobalId");
+	for (const string &id : handler.id) part.addId(id.data(), id.size());
+	return true;
+}
+
+// Fields may be quoted, with "" for a quote inside.
+static bool parseCsvLine(const char *begin, const char *end, LinePart &part) {
+	const char *cp = begin;
+	for (int field = 0; field < 3; ++field) {
+		if (field > 0) {
+			if (cp == end || *cp != ',') return part.fail("Row without three fields via,from,to");
+			++cp;
+		}
+		if (cp != end && *cp == '"') {
+			const size_t start = part.rows.text.size();
+			for (++cp; ; ++cp) {
+				if (cp == end) return part.fail("Quoted field without closing quote");
+				if (*cp == '"') {
+					if (cp + 1 == end || cp[1] != '"') break;
+					++cp;
+				}
+				part.rows.text.push_back(*cp);
+			}
+			++cp;
+			part.rows.idEnd.push_back(part.rows.text.size());
+			if (part.rows.text.size() == start) return part.fail("Empty id");
+		}
+		else {
+			const char *stop = std::find(cp, end, ',');
+			if (stop == cp) return part.fail("Empty id");
+			part.addId(cp, stop - cp);
+			cp = stop;
+		}
+	}
+	if (cp != end) return part.fail("Row with more than three fields");
+	return true;
+}
+
+// Number the from and to ids of the rows of the part, a batch at a time
+static void internPart(LinePart &part, ConcurrentInterner &interner) {
+	const size_t rows = part.rows.rows(), batch = RowBatch::Rows;
+	std::vector<string> ids(2 * std::min(rows, batch));
+	std::vector<std::uint32_t> hashes(ids.size());
+	part.points.resize(2 * rows);
+	for (size_t first = 0; first < rows; first += batch) {
+		const size_t n = 2 * std::min(rows - first, batch);
+		for (size_t i = 0; i < n; ++i) {
+			part.rows.id(3 * (first + i / 2) + 1 + i % 2, ids[i]);
+			hashes[i] = Network::hashId(ids[i]);
+		}
+		interner.intern(ids.data(), hashes.data(), n, &part.points[2 * first]);
+	}
+}
+
+static void parsePart(LinePart &part, bool json, bool skipHeader, ConcurrentInterner *interner) {
+	rapidjson::Reader parser;
+	RowHandler handler;
+	for (const char *line = part.begin; line < part.end; ) {
+		const char *next = std::find(line, part.end, '\n');
+		const char *end = next;
+		++part.lines;
+		while (end != line && (end[-1] == '\r' || end[-1] == ' ' || end[-1] == '\t')) --end;
+		while (line != end && (*line == ' ' || *line == '\t')) ++line;
+		if (line != end) {
+			if (skipHeader) skipHeader = false;
+			else if (!(json ? parseJsonLine(line, end, part, parser, handler) : parseCsvLine(line, end, part))) return;
+		}
+		line = next + (next != part.end);
+	}
+	if (interner != nullptr) internPart(part, *interner);
+}
+
+//=== Loading ================================================================
+
+// Controller ids, separated by white space
+static bool readControllers(const string &controllers_filename, std::vector<string> &controllerIds) {
+	std::ifstream controllerFile(controllers_filename);
+	if (controllerFile.fail()) {
+		std::cerr << "Cannot open controllers file " << controllers_filename << "\n";
+		return false;
+	}
+	string controllerId;
+	while (controllerFile >> controllerId) {
+		controllerIds.push_back(controllerId);
+	}
+	return true;
+}
+
+bool Network::load_lines(const string &network_filename, const string &controllers_filename, const string &starting_filename) {
+	const Timer parseTime;
+	log() << "Parsing (lines)             ... ";
+	if (!read_starting_points(starting_filename)) return false;
+	std::vector<string> controllerIds;
+	if (!readControllers(controllers_filename, controllerIds)) return false;
+	MappedFile input;
+	if (!input.open(network_filename)) return false;
+	const char *const first = input.data(), *const last = first + input.size();
+
+	// NDJSON or CSV, and does the CSV have a header?
+	const char *start = first;
+	while (start != last && std::isspace(static_cast<unsigned char>(*start))) ++start;
+	const bool json = start != last && *start == '{';
+	const char *const headerEnd = std::find(start, std::find(start, last, '\n'), ',');
+	const string firstField(start, headerEnd);
+	const bool header = !json && (firstField == "via" || firstField == "viaGlobalId" || firstField == "\"via\"" || firstField == "\"viaGlobalId\"");
+
+	// Split at newlines into parts of at least a megabyte, one per thread
+	const size_t MinPart = size_t(1) << 20;
+	const size_t threads = loadThreads != 0 ? loadThreads : std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), input.size() / MinPart));
+	std::vector<LinePart> parts(threads);
+	const char *begin = first;
+	for (size_t t = 0; t < threads; ++t) {
+		const char *end = t + 1 == threads ? last : std::max(begin, first + input.size() / threads * (t + 1));
+		end = std::find(end, last, '\n');
+		if (end != last) ++end;
+		parts[t].begin = begin;
+		parts[t].end = end;
+		begin = end;
+	}
+	ConcurrentInterner interner;
+	ConcurrentInterner *const internTo = internIds ? &interner : nullptr;
+	std::vector<std::thread> workers;
+	for (size_t t = 1; t < threads; ++t) {
+		workers.emplace_back(parsePart, std::ref(parts[t]), json, false, internTo);
+	}
+	parsePart(parts[0], json, header, internTo);
+	for (std::thread &w : workers) w.join();
+
+	size_t line = 0;
+	for (const LinePart &part : parts) {
+		if (!part.error.empty()) {
+			std::cerr << network_filename << " line " << line + part.errorLine << ": " << part.error << "\n";
+			return false;
+		}
+		line += part.lines;
+	}
+
+	// Add the rows in the order of the file
+	if (internIds) {
+		// Which id got which number depended on the threads; renumber them
+		// in order of first use, as getOrMake would have numbered them
+		std::vector<string> ids = interner.take();
+		std::vector<Index> number(ids.size(), NoIndex);
+		for (LinePart &part : parts) {
+			for (Index &p : part.points) {
+				if (number[p] == NoIndex) {
+					number[p] = static_cast<Index>(points.size());
+					points.emplace_back(std::move(ids[p]), static_cast<Index>(points.size()));
+				}
+				p = number[p];
+			}
+		}
+		pointState.resize(points.size());
+		if (!fillPointTable()) {
+			std::cerr << "Interning the ids went wrong: an id became two points\n";
+			return false;
+		}
+		for (LinePart &part : parts) {
+			addEdges(part.rows, part.points.data());
+			part.rows = RowBatch();
+		}
+	}
+	else if (sortIds) {
+		std::vector<RowBatch> batches;
+		for (LinePart &part : parts) batches.push_back(std::move(part.rows));
+		if (!addEdgesSorted(batches)) return false;
+	}
+	else {
+		for (LinePart &part : parts) {
+			addEdges(part.rows);
+			part.rows = RowBatch();
+		}
+	}
+
+	for (const string &id : controllerIds) {
+		pointState[getOrMake(id)].isController = true;
+	}
+
+	parseTime.report();
+	finish_load();
+	return true;
+}
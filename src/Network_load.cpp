@@ -2,13 +2,22 @@
 // but other's don't consistently have fopen_s.
 #define _CRT_SECURE_NO_WARNINGS
 
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <exception>
+#include <thread>
+
 #include "Network.h"
 
 using std::string;
-using std::unique_ptr;
 
 #include "Log.h"
 #include "Timer.h"
+#include "ChunkReader.h"
+#include "BinaryNetwork.h"
+#include "Pipeline.h"
+#include "Util.h"
 
 //=== Proper parser with RapidJSON ===========================================
 
@@ -16,11 +25,17 @@ using std::unique_ptr;
 #include "rapidjson/error/en.h"
 const auto RapidJsonParsingFlags = rapidjson::kParseNumbersAsStringsFlag;
 
-void Network::load(const string &network_filename, const string &starting_filename) {
+bool Network::load(const string &network_filename, const string &starting_filename) {
+	if (isRegularFile(network_filename) && isBinaryNetwork(network_filename)) {
+		return load_binary(network_filename, starting_filename);
+	}
+	if (usePipeline || !isRegularFile(network_filename) || detectCompression(network_filename) != Compression::None) {
+		return load_stream(network_filename, starting_filename);
+	}
 	const Timer parseTime;
 	log() << "Parsing                     ... ";
 	auto buffer = setup_load(network_filename, starting_filename);
-	if (buffer == nullptr) return;
+	if (buffer == nullptr) return false;
 
 	rapidjson::Document dom;
 	// In-situ parsing the buffer into DOM.
@@ -28,22 +43,258 @@ void Network::load(const string &network_filename, const string &starting_filena
 	dom.ParseInsitu<RapidJsonParsingFlags>(buffer.get());
 	if (dom.HasParseError()) {
 		std::cerr << "JSON parse error (offset " << dom.GetErrorOffset() << "): " << GetParseError_En(dom.GetParseError()) << "\n";
-		return;
+		return false;
 	}
 
 	// Make dictionary for Point ids; make graph structure
+	std::vector<RowBatch> batches(1);
 	for (auto &r : dom["rows"].GetArray()) {
-		addEdge(r["fromGlobalId"].GetString(), r["toGlobalId"].GetString(), r["viaGlobalId"].GetString());
+		for (const char *key : { "viaGlobalId", "fromGlobalId", "toGlobalId" }) {
+			const rapidjson::Value &id = r[key];
+			batches.back().addId(id.GetString(), id.GetStringLength());
+		}
+		if (batches.back().rows() == RowBatch::Rows) {
+			if (sortIds) batches.emplace_back();
+			else {
+				addEdges(batches.back());
+				batches.back().clear();
+			}
+		}
 	}
+	if (sortIds) {
+		if (!addEdgesSorted(batches)) return false;
+	}
+	else addEdges(batches.back());
 
 	// Read controllers from DOM
 	for (auto &r : dom["controllers"].GetArray()) {
-		Point *p = getOrMake(r["globalId"].GetString());
-		p->isController = true;
+		pointState[getOrMake(r["globalId"].GetString())].isController = true;
 	}
 
 	parseTime.report();
 	finish_load();
+	return true;
+}
+
+
+//=== Streaming parser for pipes and compressed files ========================
+
+// RapidJSON input stream over the chunks of a ChunkReader
+class ChunkStream {
+public:
+	using Ch = char;
+	explicit ChunkStream(ChunkReader &reader) : reader(reader) { refill(); }
+	Ch Peek() const { return cur != end ? *cur : '\0'; }
+	Ch Take() {
+		if (cur == end) return '\0';
+		const Ch c = *cur++;
+		if (cur == end) refill();
+		return c;
+	}
+	size_t Tell() const { return consumed + (cur - begin); }
+	// Only for in-situ parsing
+	Ch *PutBegin() { RAPIDJSON_ASSERT(false); return nullptr; }
+	void Put(Ch) { RAPIDJSON_ASSERT(false); }
+	void Flush() { RAPIDJSON_ASSERT(false); }
+	size_t PutEnd(Ch*) { RAPIDJSON_ASSERT(false); return 0; }
+private:
+	void refill() {
+		consumed += end - begin;
+		size_t size;
+		if (!reader.next(begin, size)) size = 0;
+		cur = begin;
+		end = begin + size;
+	}
+	ChunkReader &reader;
+	const char *begin{ nullptr }, *cur{ nullptr }, *end{ nullptr };
+	size_t consumed{ 0 };
+};
+
+// Collects the rows into batches as RapidJSON reports them, so no DOM is
+// built, and passes each full batch on to the builder (see Pipeline.h).
+// Rows and controllers are the objects in the arrays "rows" and "controllers"
+// of the top-level object. Controller ids are kept to be marked afterwards,
+// as in Network::load, where the rows come first.
+class NetworkHandler : public rapidjson::BaseReaderHandler<rapidjson::UTF8<>, NetworkHandler> {
+public:
+	NetworkHandler(SpscRing<RowBatch> &full, SpscRing<RowBatch> &empty) : full(full), empty(empty) {
+		empty.popWait(batch);
+	}
+	std::vector<string> controllerIds;
+	string error;
+	std::atomic<bool> abandoned{ false }; // the builder has given up; stop at the next row
+
+	// Pass on the last rows
+	void flush() {
+		if (batch.rows() != 0) full.pushWait(batch);
+		full.close();
+	}
+
+	bool StartObject() {
+		if (++depth == 2) list = Other;
+		else if (depth == 3) found = 0; // a row or controller; not objects nested in one
+		return Default();
+	}
+	bool StartArray() {
+		if (++depth == 2) list = section;
+		return Default();
+	}
+	bool Key(const char *str, rapidjson::SizeType length, bool) {
+		const auto is = [str, length](const char *key) { return std::strlen(key) == length && std::memcmp(str, key, length) == 0; };
+		field = nullptr;
+		if (depth == 1) {
+			section = is("rows") ? Rows : is("controllers") ? Controllers : Other;
+		}
+		else if (depth == 3 && list == Rows) {
+			if (is("viaGlobalId")) setField(via, 1);
+			else if (is("fromGlobalId")) setField(from, 2);
+			else if (is("toGlobalId")) setField(to, 4);
+		}
+		else if (depth == 3 && list == Controllers) {
+			if (is("globalId")) setField(controller, 1);
+		}
+		return true;
+	}
+	bool String(const char *str, rapidjson::SizeType length, bool) {
+		if (field != nullptr) {
+			field->assign(str, length);
+			found |= fieldBit;
+		}
+		return Default();
+	}
+	bool EndObject(rapidjson::SizeType) {
+		if (depth-- == 3) {
+			if (list == Rows) {
+				if (found != 7) return fail("Row without viaGlobalId, fromGlobalId or toGlobalId");
+				if (abandoned.load(std::memory_order_relaxed)) return fail("Loading abandoned");
+				batch.addId(via);
+				batch.addId(from);
+				batch.addId(to);
+				if (batch.rows() == RowBatch::Rows) {
+					full.pushWait(batch);
+					empty.popWait(batch);
+				}
+			}
+			else if (list == Controllers) {
+				if (found != 1) return fail("Controller without globalId");
+				controllerIds.push_back(controller);
+			}
+		}
+		return Default();
+	}
+	bool EndArray(rapidjson::SizeType) {
+		--depth;
+		return Default();
+	}
+	bool Default() {
+		field = nullptr;
+		return true;
+	}
+private:
+	SpscRing<RowBatch> &full, &empty;
+	RowBatch batch;
+	enum Section { Other, Rows, Controllers };
+	int depth{ 0 };          // of the current object or array; 1 for the top level
+	Section section{ Other }; // of the last key at the top level
+	Section list{ Other };    // the array at depth 2
+	string via, from, to, controller;
+	string *field{ nullptr }; // where the next string goes, if anywhere
+	unsigned fieldBit{ 0 }, found{ 0 };
+	void setField(string &s, unsigned bit) {
+		field = &s;
+		fieldBit = bit;
+	}
+	bool fail(const char *message) {
+		error = message;
+		return false;
+	}
+};
+
+// A pipeline of three threads: the ChunkReader reads (and decompresses) the
+// file, a tokenizer parses it into batches of rows, and this thread adds them.
+bool Network::load_stream(const string &network_filename, const string &starting_filename) {
+	const Timer parseTime;
+	log() << "Parsing (streaming)         ... ";
+	if (!read_starting_points(starting_filename)) return false;
+
+	const size_t BatchCount = 8;
+	SpscRing<RowBatch> full(BatchCount), empty(BatchCount);
+	for (size_t i = 0; i < BatchCount; ++i) {
+		RowBatch batch;
+		empty.push(batch);
+	}
+	ChunkReader reader(network_filename);
+
+	// Binary networks can come this way too, from pipes or compressed
+	const char *first;
+	size_t firstSize;
+	if (reader.peek(first, firstSize) && firstSize >= sizeof BinaryMagic && std::equal(BinaryMagic, BinaryMagic + sizeof BinaryMagic, first)) {
+		size_t length;
+		const LargeBuffer buffer = readAll(reader, length);
+		if (buffer == nullptr) {
+			std::cerr << reader.error() << "\n";
+			return false;
+		}
+		if (!load_binary(buffer.get(), length, network_filename)) return false;
+		parseTime.report();
+		finish_load();
+		return true;
+	}
+
+	NetworkHandler handler(full, empty);
+	rapidjson::Reader parser;
+	std::exception_ptr tokenizerError;
+	std::thread tokenizer([&] {
+		try {
+			ChunkStream stream(reader);
+			parser.Parse<RapidJsonParsingFlags>(stream, handler);
+		}
+		catch (...) {
+			tokenizerError = std::current_exception();
+		}
+		handler.flush();
+	});
+
+	// If adding the rows throws, stop the tokenizer and wait for it before the
+	// exception goes on: a thread that is still joinable would terminate
+	struct Join {
+		std::thread &tokenizer;
+		NetworkHandler &handler;
+		SpscRing<RowBatch> &full, &empty;
+		~Join() {
+			if (!tokenizer.joinable()) return;
+			handler.abandoned = true;
+			RowBatch batch;
+			while (full.popWait(batch)) empty.pushWait(batch);
+			tokenizer.join();
+		}
+	} join{ tokenizer, handler, full, empty };
+
+	RowBatch batch;
+	while (full.popWait(batch)) {
+		addEdges(batch);
+		batch.clear();
+		empty.pushWait(batch);
+	}
+	tokenizer.join();
+	if (tokenizerError) std::rethrow_exception(tokenizerError);
+
+	if (reader.failed()) {
+		std::cerr << reader.error() << "\n";
+		return false;
+	}
+	if (parser.HasParseError()) {
+		std::cerr << "JSON parse error (offset " << parser.GetErrorOffset() << "): "
+			<< (handler.error.empty() ? GetParseError_En(parser.GetParseErrorCode()) : handler.error.c_str()) << "\n";
+		return false;
+	}
+	for (const string &id : handler.controllerIds) {
+		pointState[getOrMake(id)].isController = true;
+	}
+
+	parseTime.report();
+	finish_load();
+	return true;
 }
 
 
@@ -51,8 +302,9 @@ void Network::load(const string &network_filename, const string &starting_filena
 
 #ifdef DONT_USE_STRING_SEARCHERS
 // the cool string searchers are C++17-only. 
-void Network::load_quick(const string &, const string &) {
+bool Network::load_quick(const string &, const string &) {
 	std::cerr << "The quick parser is not enabled in this build.\n";
+	return false;
 }
 #else
 #include <algorithm>
@@ -80,13 +332,13 @@ struct Crawler {
 	}
 };
 
-void Network::load_quick(const string &network_filename, const string &starting_filename) {
+bool Network::load_quick(const string &network_filename, const string &starting_filename) {
 	const Timer parseTime;
 	log() << "Parsing (quick)             ... ";
 	using LogParseEvents = Discard;
 	int buffer_length;
 	auto buffer = setup_load(network_filename, starting_filename, buffer_length);
-	if (buffer == nullptr) return;
+	if (buffer == nullptr) return false;
 	
 	// set up boyer-moore-horspool machines
 	const string fromKeyword = "fromGlobalId\"";
@@ -101,38 +353,46 @@ void Network::load_quick(const string &network_filename, const string &starting_
 	// search through file
 	log<LogParseEvents>() << '\n';
 	Crawler state(buffer.get(), buffer_length);
+	RowBatch batch;
 	while (!state.done()) {
 		string viaId = state.next(searchVia);
 		string fromId = state.next(searchFrom);
 		string toId = state.next(searchTo);
 		if (state.done()) break;
 		state.checkpoint();
-		addEdge(fromId, toId, viaId);
+		batch.addId(viaId);
+		batch.addId(fromId);
+		batch.addId(toId);
+		if (batch.rows() == RowBatch::Rows) {
+			addEdges(batch);
+			batch.clear();
+		}
 		log<LogParseEvents>() << "Row: " << viaId << " " << fromId << " " << toId << '\n';
 	}
+	addEdges(batch);
 	state.revert();
 	while (!state.done()) {
 		string controllerId = state.next(searchController);
 		if (state.done()) break;
-		Point *p = getOrMake(controllerId);
-		p->isController = true;
+		pointState[getOrMake(controllerId)].isController = true;
 		log<LogParseEvents>() << "Controller: " << controllerId << '\n';
 	}
 
 	parseTime.report();
 	finish_load();
+	return true;
 }
 #endif //DONT_USE_STRING_SEARCHERS
 
 //=== Dirty parser that you should not use except for fun ====================
 
-void Network::load_dirty(const string &network_filename, const string &starting_filename) {
+bool Network::load_dirty(const string &network_filename, const string &starting_filename) {
 	const Timer parseTime;
 	log() << "Parsing (dirty)             ... ";
 	auto buffer = setup_load(network_filename, starting_filename);
-	if (buffer == nullptr) return;
+	if (buffer == nullptr) return false;
 
-	string arcName;
+	RowBatch batch; // flushed before controllers, which are made in file order
 	char *first = nullptr, *second = nullptr, *third = nullptr;
 	int pos = 0;
 	char *cp = buffer.get();
@@ -148,8 +408,9 @@ void Network::load_dirty(const string &network_filename, const string &starting_
 					cp += 40;
 					c = *cp++;
 					if (c == 'a') {
-						Point *p = getOrMake(string(first));
-						p->isController = true;
+						addEdges(batch);
+						batch.clear();
+						pointState[getOrMake(string(first))].isController = true;
 						pos = 3;
 					}
 					else {
@@ -168,48 +429,115 @@ void Network::load_dirty(const string &network_filename, const string &starting_
 					third[38] = '\0';
 					cp += 115;
 					pos = 0;
-					addEdge(string(second), string(third), string(first));
+					batch.addId(first, std::strlen(first));
+					batch.addId(second, std::strlen(second));
+					batch.addId(third, std::strlen(third));
+					if (batch.rows() == RowBatch::Rows) {
+						addEdges(batch);
+						batch.clear();
+					}
 					break;
 				case 3:
 					third = cp;
 					third[38] = '\0';
 					cp += 115;
-					Point *p = getOrMake(string(third));
-					p->isController = true;
+					addEdges(batch);
+					batch.clear();
+					pointState[getOrMake(string(third))].isController = true;
 				}
 			}
 		}
 	}
+	addEdges(batch);
 
 	parseTime.report();
 	finish_load();
+	return true;
 }
 
 //=== Helper functions =======================================================
 
-Point *Network::getOrMake(const string &id) {
-	Point *&v = pointMap[id];
-	if (v == nullptr) {
-		v = new(pointPool.malloc()) Point(id);
+Index Network::getOrMake(const string &id) {
+	if (2 * (points.size() + 1) > pointTable.size()) growPointTable();
+	return getOrMake(id, hashId(id));
+}
+
+// Same, given the hash of the id, if the table has room for another point.
+Index Network::getOrMake(const string &id, std::uint32_t hash) {
+	PointSlot &slot = pointTable[findSlot(id, hash)];
+	if (slot.point != NoIndex) return slot.point;
+	const Index p = static_cast<Index>(points.size());
+	points.emplace_back(id, p);
+	pointState.emplace_back();
+	slot.hash = hash;
+	slot.point = p;
+	return p;
+}
+
+// The slot that has this id, or else the empty slot where it goes.
+// The table is never full, so this ends.
+size_t Network::findSlot(const string &id, std::uint32_t hash) const noexcept {
+	const size_t mask = pointTable.size() - 1;
+	for (size_t s = hash & mask; ; s = (s + 1) & mask) {
+		const PointSlot &slot = pointTable[s];
+		if (slot.point == NoIndex || (slot.hash == hash && points[slot.point].id == id)) return s;
+	}
+}
+
+// Put all points in pointTable at once, hashing their ids first and
+// prefetching the slots ahead; false if two points have the same id.
+bool Network::fillPointTable() {
+	const size_t Ahead = 16;
+	size_t tableSize = 16;
+	while (tableSize < 2 * (points.size() + 1)) tableSize *= 2;
+	pointTable.assign(tableSize, PointSlot{ 0, NoIndex });
+	const size_t mask = tableSize - 1;
+	std::vector<std::uint32_t> hashes(points.size());
+	for (Index p = 0; p < points.size(); ++p) hashes[p] = hashId(points[p].id);
+	for (Index p = 0; p < points.size(); ++p) {
+		if (p + Ahead < points.size()) prefetch(&pointTable[hashes[p + Ahead] & mask]);
+		PointSlot &slot = pointTable[findSlot(points[p].id, hashes[p])];
+		if (slot.point != NoIndex) return false;
+		slot.hash = hashes[p];
+		slot.point = p;
+	}
+	return true;
+}
+
+// Double the table (the size is a power of two), without looking at the ids.
+void Network::growPointTable() {
+	large_vector<PointSlot> old(std::max<size_t>(16, 2 * pointTable.size()), PointSlot{ 0, NoIndex });
+	old.swap(pointTable);
+	const size_t mask = pointTable.size() - 1;
+	for (const PointSlot &slot : old) {
+		if (slot.point == NoIndex) continue;
+		size_t s = slot.hash & mask;
+		while (pointTable[s].point != NoIndex) s = (s + 1) & mask;
+		pointTable[s] = slot;
 	}
-	return v;
 }
 
 // Load entire network file to memory; read starting points file.
-unique_ptr<char[]> Network::setup_load(const string &network_filename, const string &starting_filename) {
+LargeBuffer Network::setup_load(const string &network_filename, const string &starting_filename) {
 	int buffer_length;
 	return setup_load(network_filename, starting_filename, buffer_length);
 }
-unique_ptr<char[]> Network::setup_load(const string &network_filename, const string &starting_filename, int &buffer_length) {
-	// Read start nodes
-	std::ifstream startFile(starting_filename);
-	if (startFile.fail()) {
-		std::cerr << "Cannot open starting points file " << starting_filename << "\n";
-		return nullptr;
-	}
-	string startId;
-	while (startFile >> startId) {
-		startingIds.insert(startId);
+LargeBuffer Network::setup_load(const string &network_filename, const string &starting_filename, int &buffer_length) {
+	if (!read_starting_points(starting_filename)) return nullptr;
+	size_t length;
+	LargeBuffer buffer = read_network(network_filename, length);
+	buffer_length = static_cast<int>(length);
+	return buffer;
+}
+
+// Entire network file in memory, followed by '\0'.
+LargeBuffer Network::read_network(const string &network_filename, size_t &length) {
+	// Read (and decompress) whole stream into a buffer that grows as needed
+	if (!isRegularFile(network_filename) || detectCompression(network_filename) != Compression::None) {
+		ChunkReader reader(network_filename);
+		LargeBuffer buffer = readAll(reader, length);
+		if (buffer == nullptr) std::cerr << reader.error() << "\n";
+		return buffer;
 	}
 
 	// Read whole file into a buffers
@@ -221,20 +549,60 @@ unique_ptr<char[]> Network::setup_load(const string &network_filename, const str
 	fseek(fp, 0, SEEK_END);
 	const size_t filesize = static_cast<size_t>(ftell(fp));
 	fseek(fp, 0, SEEK_SET);
-	unique_ptr<char[]> buffer(new char[filesize + 1]);
-	buffer_length = fread(buffer.get(), 1, filesize, fp);
-	buffer[buffer_length] = '\0';
+	LargeBuffer buffer = allocateBuffer(filesize + 1);
+	length = fread(buffer.get(), 1, filesize, fp);
+	buffer[length] = '\0';
 	fclose(fp);
 	return buffer;
 }
 
+// Read start nodes, if any
+bool Network::read_starting_points(const string &starting_filename) {
+	if (starting_filename.empty()) return true;
+	std::ifstream startFile(starting_filename);
+	if (startFile.fail()) {
+		std::cerr << "Cannot open starting points file " << starting_filename << "\n";
+		return false;
+	}
+	string startId;
+	while (startFile >> startId) {
+		startingIds.insert(startId);
+	}
+	return true;
+}
+
 // Now that we have the network, mark the starting points that we read before.
 void Network::finish_load() {
+	std::vector<string>().swap(batchIds);
+	std::vector<std::uint32_t>().swap(batchHashes);
+	std::vector<Index>().swap(batchPoints);
 	for (const string &s : startingIds) {
-		const auto it = pointMap.find(s);
-		if (it != pointMap.end()) {
-			Point *p = it->second;
-			p->isStart = true;
+		const Index p = findPoint(s);
+		if (p != NoIndex) {
+			pointState[p].isStart = true;
 		}
 	}
+	buildAdjacency();
+}
+
+// Group the arcs by the point they leave, in the order they were added.
+// Arc a leaves the point that its twin a^1 goes to. Expects every arcCount
+// to be 0.
+void Network::buildAdjacency() {
+	for (Index a = 0; a < arcs.size(); ++a) {
+		++pointState[arcs[a ^ 1].to].arcCount;
+	}
+	Index first = 0;
+	for (PointState &p : pointState) {
+		p.firstArc = first;
+		first += p.arcCount;
+		p.arcCount = 0;
+	}
+	adjacency.resize(arcs.size());
+	adjacentPoints.resize(arcs.size());
+	for (Index a = 0; a < arcs.size(); ++a) {
+		PointState &p = pointState[arcs[a ^ 1].to];
+		adjacentPoints[p.firstArc + p.arcCount] = arcs[a].to;
+		adjacency[p.firstArc + p.arcCount++] = a;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,310 @@
+#include <algorithm>
+using std::sort;
+using std::max;
+using std::reverse;
+
+#include <tuple>
+using std::tuple;
+using std::get;
+using std::make_tuple;
+
+#include <string>
+using std::string;
+
+#include <vector>
+using std::vector;
+
+#include "Network.h"
+
+//=== Relabeling for locality ================================================
+
+// Points in their new order. Every traversal starts at the controllers, in
+// the order the DFS takes them; points that no controller reaches go last.
+void Network::relabelingOrder(vector<Index> &order) const {
+	vector<bool> seen(points.size(), false);
+	vector<tuple<Index, Index>> stack; // point, next position in adjacency
+	order.reserve(points.size());
+	for (Index c = 0; c < points.size(); ++c) {
+		if (seen[c] || !pointState[c].isController) continue;
+		seen[c] = true;
+		order.push_back(c);
+		if (relabeling == Relabeling::DFS) {
+			// Preorder, taking the arcs in the same order as the DFS does
+			stack.push_back(make_tuple(c, pointState[c].firstArc));
+			while (!stack.empty()) {
+				const Index p = get<0>(stack.back());
+				Index &i = get<1>(stack.back());
+				if (i == pointState[p].firstArc + pointState[p].arcCount) {
+					stack.pop_back();
+					continue;
+				}
+				const Index n = adjacentPoints[i++];
+				if (!seen[n]) {
+					seen[n] = true;
+					order.push_back(n);
+					stack.push_back(make_tuple(n, pointState[n].firstArc));
+				}
+			}
+		}
+		else {
+			// Breadth-first, using order as the queue. Cuthill-McKee takes
+			// the new neighbours of every point by increasing degree.
+			for (size_t q = order.size() - 1; q < order.size(); ++q) {
+				const size_t first = order.size();
+				for (Index a : pointArcs(order[q])) {
+					const Index n = arcs[a].to;
+					if (!seen[n]) {
+						seen[n] = true;
+						order.push_back(n);
+					}
+				}
+				if (relabeling == Relabeling::RCM) {
+					sort(order.begin() + first, order.end(), [this](Index u, Index v) {
+						return pointState[u].arcCount < pointState[v].arcCount;
+					});
+				}
+			}
+		}
+	}
+	if (relabeling == Relabeling::RCM) reverse(order.begin(), order.end());
+	for (Index p = 0; p < points.size(); ++p) {
+		if (!seen[p]) order.push_back(p);
+	}
+}
+
+// Called before the block-cut tree is built, so nobody has pointers to
+// points or arcs yet.
+void Network::relabel() {
+	vector<Index> order;
+	relabelingOrder(order);
+	vector<Index> newIndex(points.size());
+	for (Index i = 0; i < order.size(); ++i) newIndex[order[i]] = i;
+
+	large_vector<Point> newPoints;
+	large_vector<PointState> newState;
+	newPoints.reserve(points.size());
+	newState.reserve(points.size());
+	for (Index p : order) {
+		newPoints.push_back(std::move(points[p]));
+		newPoints.back().index = static_cast<Index>(newPoints.size() - 1);
+		newState.push_back(pointState[p]);
+		newState.back().arcCount = 0; // see buildAdjacency
+	}
+	points.swap(newPoints);
+	pointState.swap(newState);
+	for (PointSlot &slot : pointTable) {
+		if (slot.point != NoIndex) slot.point = newIndex[slot.point];
+	}
+
+	// Rows by their later point, with a counting sort
+	const Index rows = static_cast<Index>(arcs.size() / 2);
+	vector<Index> rowStart(points.size() + 1, 0);
+	for (Index r = 0; r < rows; ++r) {
+		++rowStart[max(newIndex[arcs[2 * r].to], newIndex[arcs[2 * r + 1].to]) + 1];
+	}
+	for (size_t p = 1; p < rowStart.size(); ++p) rowStart[p] += rowStart[p - 1];
+	vector<Index> rowOrder(rows);
+	for (Index r = 0; r < rows; ++r) {
+		rowOrder[rowStart[max(newIndex[arcs[2 * r].to], newIndex[arcs[2 * r + 1].to])]++] = r;
+	}
+	large_vector<Arc> newArcs;
+	newArcs.reserve(arcs.size());
+	for (Index r : rowOrder) {
+		for (Index a = 2 * r; a <= 2 * r + 1; ++a) {
+			newArcs.push_back(std::move(arcs[a]));
+			newArcs.back().to = newIndex[newArcs.back().to];
+		}
+	}
+	arcs.swap(newArcs);
+	buildAdjacency();
+}
+
+//=== Peeling hanging trees ==================================================
+
+void Network::peelTrees() {
+	// Remaining degree of every point, or -1 once it is peeled
+	vector<int> degree(points.size());
+	vector<Index> queue;
+	for (Index p = 0; p < points.size(); ++p) {
+		degree[p] = static_cast<int>(pointState[p].arcCount);
+		if (degree[p] == 1 && !pointState[p].isController) queue.push_back(p);
+	}
+	vector<Index> touched; // points that lost an arc, maybe more than once
+	for (size_t q = 0; q < queue.size(); ++q) {
+		const Index x = queue[q];
+		degree[x] = -1;
+		for (Index a : pointArcs(x)) {
+			const Index y = arcs[a].to;
+			if (degree[y] < 0) continue;
+			if (--degree[y] == 1 && !pointState[y].isController) queue.push_back(y);
+			touched.push_back(y);
+		}
+	}
+
+	// Take the arcs into the trees out of the core: they go to the end of
+	// the point's arcs, past arcCount. A core point with a tree is a cut
+	// vertex, unless that tree is all there is.
+	for (Index y : touched) {
+		if (degree[y] < 0) continue;
+		PointState &point = pointState[y];
+		Index * const pointArcs = adjacency.data() + point.firstArc;
+		Index kept = 0, trees = 0;
+		for (Index i = 0; i < point.arcCount; ++i) {
+			const Index a = pointArcs[i];
+			if (degree[arcs[a].to] < 0) {
+				treeArcs.push_back(make_tuple(y, a));
+				++trees;
+			}
+			else {
+				adjacentPoints[point.firstArc + kept] = arcs[a].to;
+				pointArcs[kept++] = a;
+			}
+		}
+		if (trees == 0) continue; // seen before
+		for (Index i = 0; i < trees; ++i) {
+			const Index a = get<1>(treeArcs[treeArcs.size() - trees + i]);
+			adjacentPoints[point.firstArc + kept + i] = arcs[a].to;
+			pointArcs[kept + i] = a;
+		}
+		point.arcCount = kept;
+		point.cutByTrees = kept > 0 || trees > 1;
+	}
+}
+
+// Unwind every tree edge as a bridge, from the core outwards, and give the
+// core points their arcs back. Trees in components without a controller
+// were not reached by the DFS and are skipped, as the DFS would have.
+void Network::attachTrees() {
+	vector<tuple<Index, Index>> stack;
+	for (const auto &t : treeArcs) {
+		const Index y = get<0>(t);
+		if (pointState[y].visited) {
+			// A controller with only trees has no block yet: its first bridge is the root
+			const bool root = pointState[y].arcCount == 0;
+			Index first = NoIndex;
+			stack.push_back(t);
+			while (!stack.empty()) {
+				const Index p = get<0>(stack.back());
+				const Index a = get<1>(stack.back());
+				stack.pop_back();
+				const Index x = arcs[a].to;
+				pointState[x].visited = true;
+				if (pointState[x].arcCount > 1) makeArticulation(x);
+				bcStack.push_back(make_tuple(p, a));
+				const Index bridge = unwindBlock(p, x);
+				if (first == NoIndex) first = bridge;
+				for (Index b : pointArcs(x)) {
+					if (arcs[b].to != p) stack.push_back(make_tuple(x, b));
+				}
+			}
+			if (root) bcRoots.push_back(first);
+		}
+		++pointState[y].arcCount; // it is right after the others
+	}
+	treeArcs.clear();
+	treeArcs.shrink_to_fit();
+}
+
+//=== Chain contraction ======================================================
+
+// Controllers and starts are kept as ends of chains, so that the flags on
+// blocks and cut nodes come out the same as without contraction.
+bool Network::isChainInterior(Index p) const noexcept {
+	const PointState &point = pointState[p];
+	if (point.arcCount != 2 || point.isController || point.isStart || point.cutByTrees) return false;
+	return arcs[adjacency[point.firstArc]].to != arcs[adjacency[point.firstArc + 1]].to;
+}
+
+void Network::contractChains() {
+	struct Walk { Index to; Index arc; Index first, count; };
+	vector<Walk> walks; // the arcs of u, with their target after contraction
+	vector<tuple<Index, Index, Index>> contract; // position in adjacency, range in chainedArcs
+	for (Index u = 0; u < points.size(); ++u) {
+		if (isChainInterior(u)) continue;
+
+		// Walk every chain that starts here
+		walks.clear();
+		bool anyChain = false;
+		const PointState &point = pointState[u];
+		for (Index i = point.firstArc; i < point.firstArc + point.arcCount; ++i) {
+			Index a = adjacency[i];
+			Index x = arcs[a].to;
+			const Index first = static_cast<Index>(chainedArcs.size());
+			if (isChainInterior(x)) {
+				Index prev = u;
+				chainedArcs.push_back(a);
+				do {
+					const Index *interior = adjacency.data() + pointState[x].firstArc;
+					a = arcs[interior[0]].to == prev ? interior[1] : interior[0];
+					prev = x;
+					x = arcs[a].to;
+					chainedArcs.push_back(a);
+				} while (isChainInterior(x));
+				anyChain = true;
+			}
+			walks.push_back({ x, i, first, static_cast<Index>(chainedArcs.size()) - first });
+		}
+		if (!anyChain) continue;
+
+		// A chain back to u, or parallel to another arc of u, stays as it is:
+		// the DFS handles neither loops nor parallel arcs. The other end of
+		// the chain sees the same parallel arcs and makes the same decision.
+		sort(walks.begin(), walks.end(), [](const Walk &a, const Walk &b) { return a.to < b.to; });
+		for (size_t j = 0; j < walks.size(); ++j) {
+			const Walk &w = walks[j];
+			const bool parallel = (j > 0 && walks[j - 1].to == w.to) || (j + 1 < walks.size() && walks[j + 1].to == w.to);
+			if (w.count == 0 || parallel || w.to == u) continue;
+			contract.push_back(make_tuple(w.arc, w.first, w.count));
+		}
+	}
+
+	// The chain arcs go after the real ones. This may move all arcs once,
+	// which is fine since nothing refers to them by pointer yet.
+	firstChainArc = static_cast<Index>(arcs.size());
+	arcs.reserve(arcs.size() + contract.size());
+	chains.reserve(contract.size());
+	contractedArcs.reserve(contract.size());
+	for (const auto &c : contract) {
+		const Index i = get<0>(c);
+		const Chain chain = { get<1>(c), get<2>(c) };
+		const Index end = arcs[chainedArcs[chain.first + chain.count - 1]].to;
+		chains.push_back(chain);
+		contractedArcs.push_back(make_tuple(i, adjacency[i]));
+		adjacency[i] = static_cast<Index>(arcs.size());
+		adjacentPoints[i] = end;
+		arcs.emplace_back(end, string(), -1);
+		arcs.back().isChain = true;
+	}
+}
+
+// Put back the original arcs; the blocks only refer to those.
+void Network::restoreChains() {
+	for (const auto &c : contractedArcs) {
+		adjacency[get<0>(c)] = get<1>(c);
+		adjacentPoints[get<0>(c)] = arcs[get<1>(c)].to;
+	}
+	arcs.erase(arcs.begin() + firstChainArc, arcs.end());
+	contractedArcs.clear();
+	contractedArcs.shrink_to_fit();
+	chains.clear();
+	chains.shrink_to_fit();
+	chainedArcs.clear();
+	chainedArcs.shrink_to_fit();
+}
+
+// The chain p = x_0, x_1, ..., x_k+1 = chain end is a block on its own, so in the
+// original graph x_1 .. x_k are articulations with a bridge in between each. Unwind
+// those bridges from the far end, as the DFS would have done, and leave the first
+// arc of the chain on the stack in place of the chain, for unwinding as usual.
+void Network::unwindChain(Index p, Index chainArc) {
+	bcStack.pop_back();
+	const Chain chain = chains[chainArc - firstChainArc];
+	const Index * const chainArcs = chainedArcs.data() + chain.first;
+	for (Index i = chain.count - 1; i > 0; --i) {
+		const Index x = arcs[chainArcs[i - 1]].to;
+		makeArticulation(x); // never a controller or start
+		bcStack.push_back(make_tuple(x, chainArcs[i]));
+		unwindBlock(x, arcs[chainArcs[i]].to);
+	}
+	bcStack.push_back(make_tuple(p, chainArcs[0]));
+}
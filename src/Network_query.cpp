@@ -0,0 +1,298 @@
+#include <algorithm>
+
+#include "Network.h"
+
+using std::string;
+using std::vector;
+
+//=== Looking up features by id ==============================================
+
+Index Network::findPoint(const string &id) const {
+	if (pointTable.empty()) return NoIndex;
+	return pointTable[findSlot(id, hashId(id))].point;
+}
+
+// Nodes of the block-cut tree that contain the point or edge with this id.
+// A point is in one node: its articulation node or its only block.
+// An edge id can occur in several rows, and therefore in several blocks.
+// Points that are not connected to a controller are in no node at all.
+void Network::findNodes(const string &id, vector<Index> &found) {
+	const Index p = findPoint(id);
+	if (p != NoIndex) {
+		const PointInTree &point = pointTree[p];
+		if (point.articulation != NoIndex) found.push_back(point.articulation);
+		else if (point.block != NoIndex) found.push_back(point.block);
+		return;
+	}
+	indexEdges();
+	const auto range = edgeNodes.equal_range(id);
+	for (auto it = range.first; it != range.second; ++it) {
+		found.push_back(it->second);
+	}
+}
+
+void Network::indexEdges() {
+	if (edgesIndexed) return;
+	edgesIndexed = true;
+	buildIndex();
+	for (Index r : bcRoots) {
+		indexEdges(r, NoIndex);
+	}
+}
+
+void Network::indexEdges(Index v, Index parent) {
+	for (Index a : nodeEdges(nodes[v])) {
+		edgeNodes.emplace(arcs[a].id, v);
+	}
+	for (const auto &n : nodeNeighbors(nodes[v])) {
+		if (n.to != parent) {
+			indexEdges(n.to, v);
+		}
+	}
+}
+
+//=== Counting upstream features =============================================
+
+UpstreamCount Network::countUpstreamFeatures() {
+	buildIndex();
+	++epoch;
+	UpstreamCount count;
+	for (Index s : startNodes) {
+		if (nodes[s].visited != epoch) {
+			countFromStartnode(s, NoIndex, count);
+		}
+	}
+	return count;
+}
+
+UpstreamCount Network::countUpstreamFeatures(const vector<string> &startIds) {
+	buildIndex();
+	++epoch;
+	UpstreamCount count;
+	vector<Index> bridgeStarts;
+	vector<Index> found;
+	for (const string &id : startIds) {
+		// Like the flood, but a bridge only counts its start points
+		// from the starting points file.
+		const Index p = findPoint(id);
+		if (p != NoIndex && pointTree[p].block != NoIndex && nodes[pointTree[p].block].isBridge() && !pointTree[p].isController && !pointTree[p].isStart) {
+			if (std::find(bridgeStarts.begin(), bridgeStarts.end(), p) == bridgeStarts.end()) {
+				bridgeStarts.push_back(p);
+				++count.points;
+			}
+		}
+		found.clear();
+		findNodes(id, found);
+		for (Index v : found) {
+			if (nodes[v].visited != epoch) {
+				countFromStartnode(v, NoIndex, count);
+			}
+		}
+	}
+	return count;
+}
+
+// Same traversal as floodFromStartnode. Points of a block that are not shared
+// are in its pointCount; a shared cut vertex is counted once, either when its
+// cut node is visited or when a block that outputs it (not a bridge) is.
+void Network::countFromStartnode(Index v, Index parent, UpstreamCount &count) noexcept {
+	BCNode &node = nodes[v];
+	node.visited = epoch;
+	count.edges += node.edgesSize;
+	count.points += node.pointCount;
+	if (node.isCut() && node.counted != epoch) {
+		node.counted = epoch;
+		++count.points;
+	}
+	const bool outputsCuts = !node.isCut() && !node.isBridge();
+	for (const auto &n : nodeNeighbors(node)) {
+		BCNode &next = nodes[n.to];
+		if (outputsCuts && next.counted != epoch) {
+			next.counted = epoch;
+			++count.points;
+		}
+		if (n.to != parent && n.marked && next.visited != epoch) {
+			countFromStartnode(n.to, v, count);
+		}
+	}
+}
+
+//=== Euler tour and heavy-light decomposition ===============================
+
+void Network::tourBCTree() {
+	if (toured) return;
+	toured = true;
+	buildIndex();
+	int component = 0;
+	for (Index c : controllerNodes) {
+		if (nodes[c].component < 0) {
+			componentRoots.push_back(c);
+			sizeBCTree(c, NoIndex, component++);
+			tourBCTree(c, c);
+		}
+	}
+}
+
+// First pass: parents and heavy children. Returns the size of the subtree of v.
+int Network::sizeBCTree(Index v, Index parent, int component) {
+	BCNode &node = nodes[v];
+	node.parent = parent;
+	node.component = component;
+	int size = 1, heaviest = 0;
+	for (const auto &n : nodeNeighbors(node)) {
+		if (n.to != parent) {
+			const int childSize = sizeBCTree(n.to, v, component);
+			size += childSize;
+			if (childSize > heaviest) {
+				heaviest = childSize;
+				node.heavy = n.to;
+			}
+		}
+	}
+	return size;
+}
+
+// Second pass: tour times, heavy child first; heads of heavy paths; the core.
+void Network::tourBCTree(Index v, Index head) {
+	BCNode &node = nodes[v];
+	node.head = head;
+	node.tin = static_cast<int>(tourOrder.size());
+	tourOrder.push_back(v);
+	node.core = node.hasController;
+	if (node.heavy != NoIndex) {
+		tourBCTree(node.heavy, head);
+		node.core |= nodes[node.heavy].core;
+	}
+	for (const auto &n : nodeNeighbors(node)) {
+		if (n.to != node.parent && n.to != node.heavy) {
+			tourBCTree(n.to, n.to);
+			node.core |= nodes[n.to].core;
+		}
+	}
+	node.tout = static_cast<int>(tourOrder.size());
+}
+
+// Is v on a path from s to a controller?
+bool Network::onUpstreamPath(const BCNode &v, const BCNode &s) const noexcept {
+	return v.component == s.component && (v.core || v.isAncestorOf(s));
+}
+
+bool Network::isUpstream(const string &featureId, const string &startId) {
+	tourBCTree();
+	vector<Index> starts;
+	findNodes(startId, starts);
+	if (starts.empty()) return false;
+	if (featureId == startId) return true;
+
+	// The feature is upstream iff one of these nodes is.
+	vector<Index> found;
+	const Index p = findPoint(featureId);
+	if (p == NoIndex) {
+		// An edge, in one or more blocks
+		findNodes(featureId, found);
+	}
+	else if (pointTree[p].articulation != NoIndex) {
+		// Output by its cut node, or by its parent block unless that is a bridge.
+		// Its child blocks are only upstream if the cut node is.
+		const BCNode &c = nodes[pointTree[p].articulation];
+		found.push_back(pointTree[p].articulation);
+		if (c.parent != NoIndex && !nodes[c.parent].isBridge()) found.push_back(c.parent);
+	}
+	else if (pointTree[p].block != NoIndex) {
+		// The end of a bridge is only output if it is a controller or start
+		const PointInTree &point = pointTree[p];
+		if (!nodes[point.block].isBridge() || point.isController || point.isStart) found.push_back(point.block);
+	}
+
+	for (Index s : starts) {
+		for (Index v : found) {
+			if (onUpstreamPath(nodes[v], nodes[s])) return true;
+		}
+	}
+	return false;
+}
+
+//=== Pre-rendered text queries ==============================================
+
+void Network::renderBCTree() {
+	if (renderedIndex) return;
+	renderedIndex = true;
+	tourBCTree();
+	StringSink sink(rendered);
+	renderedOffset.reserve(tourOrder.size() + 1);
+	for (Index v : tourOrder) {
+		renderedOffset.push_back(rendered.size());
+		outputContents(nodes[v], sink);
+	}
+	renderedOffset.push_back(rendered.size());
+
+	// Trees are toured one after the other, so a root starts the next component.
+	for (Index v : tourOrder) {
+		const BCNode &node = nodes[v];
+		if (node.parent == NoIndex) coreRanges.emplace_back();
+		if (node.core) addRange(coreRanges.back(), node.tin, node.tin);
+	}
+}
+
+// Append the text of the nodes with tin firstTin..lastTin,
+// extending the last range if they are adjacent.
+void Network::addRange(vector<TextRange> &ranges, int firstTin, int lastTin) const {
+	const char *data = rendered.data() + renderedOffset[firstTin];
+	const size_t size = renderedOffset[lastTin + 1] - renderedOffset[firstTin];
+	if (size == 0) return;
+	if (!ranges.empty() && ranges.back().data + ranges.back().size == data) {
+		ranges.back().size += size;
+	}
+	else {
+		ranges.push_back({ data, size });
+	}
+}
+
+// The upstream nodes of s are the core of its tree and the path up to the core.
+// That path is climbed one heavy path at a time, each giving one range. A heavy
+// path that another start already climbed in this query is only output below
+// the part that is already done, and then the rest above is done as well.
+void Network::upstreamText(const vector<string> &startIds, vector<TextRange> &pieces) {
+	renderBCTree();
+	++epoch;
+	vector<Index> found;
+	for (const string &id : startIds) {
+		// A start point at the end of a bridge is not in the rendered text.
+		const Index p = findPoint(id);
+		if (p != NoIndex && pointTree[p].block != NoIndex && nodes[pointTree[p].block].isBridge()) {
+			pieces.push_back({ points[p].id.data(), points[p].id.size() });
+			pieces.push_back({ "\n", 1 });
+		}
+		found.clear();
+		findNodes(id, found);
+		for (Index s : found) {
+			const int component = nodes[s].component;
+			BCNode &root = nodes[componentRoots[component]];
+			if (root.visited != epoch) {
+				root.visited = epoch;
+				pieces.insert(pieces.end(), coreRanges[component].begin(), coreRanges[component].end());
+			}
+			for (Index v = s; v != NoIndex && !nodes[v].core; ) {
+				const int tin = nodes[v].tin;
+				BCNode &head = nodes[nodes[v].head];
+				int first = head.tin;
+				if (head.core) {
+					// The core is a prefix of the heavy path
+					const auto begin = tourOrder.begin() + head.tin, end = tourOrder.begin() + tin + 1;
+					first = static_cast<int>(std::partition_point(begin, end, [this](Index u) { return nodes[u].core; }) - tourOrder.begin());
+				}
+				if (head.covered == epoch) {
+					if (tin > head.coveredTin) {
+						addRange(pieces, std::max(first, head.coveredTin + 1), tin);
+						head.coveredTin = tin;
+					}
+					break;
+				}
+				head.covered = epoch;
+				head.coveredTin = tin;
+				addRange(pieces, first, tin);
+				v = head.parent;
+			}
+		}
+	}
+}
@@ -0,0 +1,172 @@
+// Resolving the point ids of all rows at once, by sorting them
+
+#include <algorithm>
+#include <atomic>
+#include <cstring>
+#include <thread>
+
+#include "Network.h"
+
+using std::string;
+using std::uint32_t;
+using std::uint64_t;
+
+// === Description ===
+// Instead of looking up every from and to id in pointTable as it comes
+// along, which costs a few cache misses each time, all these occurrences are
+// collected and sorted by id. Equal ids then lie next to each other, and the
+// first occurrence of each is its first use; numbering the points in order
+// of first use gives the same numbers as getOrMake would.
+//
+// The sort is one radix pass on the first two bytes after the prefix that
+// all ids share, followed by sorting each of the 65536 buckets by the eight
+// bytes after that prefix and then the whole id. Counting, scattering and
+// sorting the buckets are divided over the cores; numbering is one pass in
+// the order of the rows.
+
+namespace {
+
+// One occurrence of a point id, as from or to of a row
+struct IdRef {
+	uint64_t key;        // eight bytes after the common prefix, big-endian
+	const char *text;
+	uint32_t length;
+	uint32_t occurrence; // 2r for the from id of row r, 2r+1 for the to id
+};
+
+const int RadixBits = 16;
+const size_t Buckets = size_t(1) << RadixBits;
+const size_t MinSlice = size_t(1) << 16; // occurrences for a thread
+
+size_t bucketOf(const IdRef &ref) noexcept { return static_cast<size_t>(ref.key >> (64 - RadixBits)); }
+
+// Run work(t) for t = 0 .. threads-1, each on its own thread (0 on this one)
+template< typename Work >
+void inParallel(size_t threads, Work work) {
+	std::vector<std::thread> workers;
+	for (size_t t = 1; t < threads; ++t) workers.emplace_back(work, t);
+	work(0);
+	for (std::thread &w : workers) w.join();
+}
+
+} // namespace
+
+bool Network::addEdgesSorted(std::vector<RowBatch> &batches) {
+	if (!points.empty()) {
+		for (const RowBatch &batch : batches) addEdges(batch);
+		return true;
+	}
+	size_t rows = 0;
+	for (const RowBatch &batch : batches) rows += batch.rows();
+	if (rows == 0) return true;
+	const size_t n = 2 * rows;
+	const size_t threads = loadThreads != 0 ? loadThreads : std::max<size_t>(1, std::min<size_t>(std::thread::hardware_concurrency(), n / MinSlice));
+	const auto slice = [n, threads](size_t t) { return std::make_pair(n * t / threads, n * (t + 1) / threads); };
+
+	// The occurrences, in order of the rows
+	large_vector<IdRef> refs(n);
+	size_t o = 0;
+	for (const RowBatch &batch : batches) {
+		for (size_t i = 0; i < batch.idEnd.size(); ++i) {
+			if (i % 3 == 0) continue; // via
+			const size_t begin = i == 0 ? 0 : batch.idEnd[i - 1];
+			refs[o] = IdRef{ 0, batch.text.data() + begin, static_cast<uint32_t>(batch.idEnd[i] - begin), static_cast<uint32_t>(o) };
+			++o;
+		}
+	}
+
+	// The prefix that all ids share does not help sorting, so the keys start after it
+	std::vector<size_t> prefixOf(threads, refs[0].length);
+	inParallel(threads, [&](size_t t) {
+		size_t &prefix = prefixOf[t];
+		for (size_t i = slice(t).first; i < slice(t).second; ++i) {
+			prefix = std::min<size_t>(prefix, refs[i].length);
+			prefix = std::mismatch(refs[0].text, refs[0].text + prefix, refs[i].text).first - refs[0].text;
+		}
+	});
+	const size_t prefix = *std::min_element(prefixOf.begin(), prefixOf.end());
+
+	// Keys and one radix pass, counting and scattering a slice per thread
+	std::vector<std::vector<size_t>> counts(threads, std::vector<size_t>(Buckets, 0));
+	inParallel(threads, [&](size_t t) {
+		for (size_t i = slice(t).first; i < slice(t).second; ++i) {
+			IdRef &ref = refs[i];
+			const size_t bytes = std::min<size_t>(8, ref.length - prefix);
+			uint64_t key = 0;
+			for (size_t b = 0; b < 8; ++b) {
+				key = key << 8 | (b < bytes ? static_cast<unsigned char>(ref.text[prefix + b]) : 0u);
+			}
+			ref.key = key;
+			++counts[t][bucketOf(ref)];
+		}
+	});
+	std::vector<size_t> bucketStart(Buckets + 1, 0);
+	size_t start = 0;
+	for (size_t b = 0; b < Buckets; ++b) {
+		bucketStart[b] = start;
+		for (size_t t = 0; t < threads; ++t) {
+			const size_t count = counts[t][b];
+			counts[t][b] = start; // where slice t puts its first one
+			start += count;
+		}
+	}
+	bucketStart[Buckets] = n;
+	large_vector<IdRef> sorted(n);
+	inParallel(threads, [&](size_t t) {
+		std::vector<size_t> &next = counts[t];
+		for (size_t i = slice(t).first; i < slice(t).second; ++i) {
+			sorted[next[bucketOf(refs[i])]++] = refs[i];
+		}
+	});
+
+	// Sort each bucket; every occurrence learns the first occurrence of its id
+	const auto before = [prefix](const IdRef &a, const IdRef &b) {
+		if (a.key != b.key) return a.key < b.key;
+		const int order = std::memcmp(a.text + prefix, b.text + prefix, std::min(a.length, b.length) - prefix);
+		if (order != 0) return order < 0;
+		if (a.length != b.length) return a.length < b.length;
+		return a.occurrence < b.occurrence;
+	};
+	const auto same = [prefix](const IdRef &a, const IdRef &b) {
+		return a.key == b.key && a.length == b.length && std::memcmp(a.text + prefix, b.text + prefix, a.length - prefix) == 0;
+	};
+	large_vector<Index> pointOf(n);
+	std::atomic<size_t> nextBucket{ 0 };
+	inParallel(threads, [&](size_t) {
+		for (size_t b; (b = nextBucket++) < Buckets; ) {
+			IdRef *const first = &sorted[0] + bucketStart[b], *const last = &sorted[0] + bucketStart[b + 1];
+			std::sort(first, last, before);
+			for (IdRef *run = first; run != last; ) {
+				IdRef *end = run + 1;
+				while (end != last && same(*run, *end)) ++end;
+				for (IdRef *r = run; r != end; ++r) pointOf[r->occurrence] = run->occurrence;
+				run = end;
+			}
+		}
+	});
+	large_vector<IdRef>().swap(sorted);
+
+	// Number the points in order of first use
+	for (o = 0; o < n; ++o) {
+		const Index first = pointOf[o];
+		if (first == o) {
+			pointOf[o] = static_cast<Index>(points.size());
+			points.emplace_back(string(refs[o].text, refs[o].length), static_cast<Index>(points.size()));
+		}
+		else pointOf[o] = pointOf[first];
+	}
+	pointState.resize(points.size());
+	if (!fillPointTable()) {
+		std::cerr << "Sorting the ids went wrong: an id became two points\n";
+		return false;
+	}
+
+	// Rows, in order
+	arcs.reserve(arcs.size() + n);
+	o = 0;
+	for (const RowBatch &batch : batches) {
+		addEdges(batch, pointOf.data() + o);
+		o += 2 * batch.rows();
+	}
+	return true;
+}
@@ -0,0 +1,95 @@
+// Passing rows between the threads of a loader
+
+#ifndef INCLUDED_PIPELINE
+#define INCLUDED_PIPELINE
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+// === Description ===
+// A loader can run as a pipeline: one thread reads the file (see
+// ChunkReader.h), one tokenizes it into batches of rows, and one adds the
+// rows to the network. The batches go from the tokenizer to the builder
+// through one SpscRing, and come back empty through another, so their memory
+// is reused.
+//
+// SpscRing is a fixed-size ring buffer for one producer thread and one
+// consumer thread, without locks: each side only writes its own position.
+// Waiting is done by yielding, which is fine as long as the items are large
+// (a batch holds thousands of rows).
+
+// The rows of one batch. Their ids are stored one after another in text;
+// idEnd[3r], idEnd[3r+1] and idEnd[3r+2] are where the via, from and to id
+// of row r end.
+struct RowBatch {
+	std::string text;
+	std::vector<std::size_t> idEnd;
+
+	static const std::size_t Rows = 4096; // in a full batch
+
+	std::size_t rows() const noexcept { return idEnd.size() / 3; }
+	void addId(const char *id, std::size_t length) {
+		text.append(id, length);
+		idEnd.push_back(text.size());
+	}
+	void addId(const std::string &id) { addId(id.data(), id.size()); }
+	// Copy the i-th id in the batch
+	void id(std::size_t i, std::string &id) const {
+		id.assign(text.data() + (i == 0 ? 0 : idEnd[i - 1]), text.data() + idEnd[i]);
+	}
+	void clear() noexcept {
+		text.clear();
+		idEnd.clear();
+	}
+};
+
+template< typename T >
+class SpscRing {
+public:
+	explicit SpscRing(std::size_t capacity) : slots(capacity) {}
+	SpscRing(const SpscRing&) = delete;
+	SpscRing &operator=(const SpscRing&) = delete;
+
+	// Producer: moves the item in; false (and item untouched) if the ring is full.
+	bool push(T &item) {
+		const std::size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == slots.size()) return false;
+		slots[t % slots.size()] = std::move(item);
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	void pushWait(T &item) {
+		while (!push(item)) std::this_thread::yield();
+	}
+	// Producer: nothing more will be pushed.
+	void close() { closed.store(true, std::memory_order_release); }
+
+	// Consumer: moves an item out; false if the ring is empty.
+	bool pop(T &item) {
+		const std::size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		item = std::move(slots[h % slots.size()]);
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+	// Consumer: false once the ring is closed and empty.
+	bool popWait(T &item) {
+		while (!pop(item)) {
+			if (closed.load(std::memory_order_acquire)) return pop(item);
+			std::this_thread::yield();
+		}
+		return true;
+	}
+
+private:
+	std::vector<T> slots;
+	alignas(64) std::atomic<std::size_t> head{ 0 }; // next to pop
+	alignas(64) std::atomic<std::size_t> tail{ 0 }; // next to push
+	std::atomic<bool> closed{ false };
+};
+
+#endif //ndef INCLUDED_PIPELINE
@@ -4,27 +4,45 @@
 #define INCLUDED_POINT
 
 #include <string>
+#include <utility>
 #include "Settings.h"
 
-class Arc;
-class BCNode;
-
+// The id of a point, as handed to sinks. Nothing else is read from it
+// while the block-cut tree is built.
 class Point {
 public:
-	Point(const std::string &id) : id(id) {}
-	
-	// network information
+	Point(std::string id, Index index) : id(std::move(id)), index(index) {}
+
 	std::string id;
+	Index index; // position in Network::points, in order of creation
+};
+
+// Everything else about a point while the block-cut tree is built, in
+// Network::pointState by the same index. This is what the Hopcroft-Tarjan DFS
+// touches on every step, so it is kept small and away from the ids: two
+// points to a cache line. The queries use PointInTree instead.
+struct PointState {
+	// network information
+	Index firstArc{ 0 }, arcCount{ 0 }; // range in Network::adjacency
 	bool isController{ false };
 	bool isStart{ false };
-	small_vector<Arc*> arcs;
 
-	// for Hopcroft-Tarjan and BC-tree
-	BCNode *articulation{ nullptr };
+	// for Hopcroft-Tarjan and BC-tree; nodes are in Network::nodes
 	bool visited{ false };
-	Point *dfsParent{ nullptr };
+	bool cutByTrees{ false }; // trees were peeled off here, see Network::peelTrees
+	Index articulation{ NoIndex };
+	Index block{ NoIndex }; // the only block containing this point, if not an articulation
+	Index dfsParent{ NoIndex };
 	int time{ 0 }, low{ 0 };
+};
 
+// Where a point ended up in the block-cut tree: all that the queries need
+// to know about it besides its id. In Network::pointTree by point index.
+struct PointInTree {
+	Index articulation{ NoIndex }; // its cut node, if it is an articulation
+	Index block{ NoIndex };        // otherwise its only block, if any
+	bool isController{ false };
+	bool isStart{ false };
 };
 
 #endif //ndef INCLUDED_POINT
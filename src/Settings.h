@@ -1,16 +1,24 @@
 #ifndef INCLUDED_SETTINGS
 #define INCLUDED_SETTINGS
 
-// Use Boost's small vector
-#define BOOST_SMALL_VECTOR
-#ifdef BOOST_SMALL_VECTOR
-#include <boost/container/small_vector.hpp>
-template< typename T > using small_vector = boost::container::small_vector<T,4>;
-#else
+#include <cstddef>
+#include <cstdint>
 #include <vector>
-template< typename T > using small_vector = std::vector<T>;
-#endif
 
+// Back the large arrays of the network with huge pages where possible, see HugePages.h
+#define HUGE_PAGES
+#include "HugePages.h"
+template< typename T > using large_vector = std::vector<T, HugePageAllocator<T>>;
+
+// Read gzip-compressed network files with zlib (link with -lz) and
+// zstd-compressed ones with libzstd (link with -lzstd), see ChunkReader.h
+#define USE_ZLIB
+//#define USE_ZSTD
+
+// Points, arcs and block-cut tree nodes live in dense arrays in the Network
+// and refer to each other by 32-bit index. NoIndex is the null reference.
+using Index = std::uint32_t;
+const Index NoIndex = ~Index(0);
 
 // Windows and Linux want different modes for fopen
 extern const char *fopenMode;
@@ -0,0 +1,137 @@
+// Sinks that receive upstream features from
+// Network::enumerateUpstreamFeatures()
+
+#ifndef INCLUDED_SINK
+#define INCLUDED_SINK
+
+#include <string>
+#include <vector>
+#include <ostream>
+#include <cstring>
+#include <cstddef>
+
+#include "Point.h"
+#include "Arc.h"
+
+// === Description ===
+// The traversal is templated on its sink, so every use compiles to direct
+// calls and only the text sink does any formatting. A sink is any class with
+//
+//   void edge(const Arc *a);      // a->id is the edge id, a->index its row
+//   void point(const Point *p);   // p->id is the point id, p->index its number
+//
+// Features may be reported more than once, exactly like the text output.
+//
+// Usage: CountSink count;
+//        net.enumerateUpstreamFeatures(count);
+
+// Write ids to a stream, one per line, through a local buffer.
+class TextSink {
+public:
+	explicit TextSink(std::ostream &out) : out(out) {}
+	~TextSink() { flush(); }
+	TextSink(const TextSink&) = delete;
+	TextSink &operator=(const TextSink&) = delete;
+
+	void edge(const Arc *a) { write(a->id); }
+	void point(const Point *p) { write(p->id); }
+
+	void flush() {
+		out.write(buffer, used);
+		used = 0;
+	}
+
+private:
+	void write(const std::string &s) {
+		if (used + s.size() + 1 > sizeof(buffer)) {
+			flush();
+			if (s.size() + 1 > sizeof(buffer)) {
+				out << s << '\n';
+				return;
+			}
+		}
+		std::memcpy(buffer + used, s.data(), s.size());
+		used += s.size();
+		buffer[used++] = '\n';
+	}
+	std::ostream &out;
+	std::size_t used{ 0 };
+	char buffer[1 << 16];
+};
+
+// Write ids, one per line, into caller-owned memory. Stops writing when the
+// memory is full, but keeps counting how many bytes would have been needed.
+class BufferSink {
+public:
+	BufferSink(char *buffer, std::size_t capacity) : buffer(buffer), capacity(capacity) {}
+
+	void edge(const Arc *a) noexcept { write(a->id); }
+	void point(const Point *p) noexcept { write(p->id); }
+
+	bool overflow() const noexcept { return needed > capacity; }
+	std::size_t needed{ 0 };
+
+private:
+	void write(const std::string &s) noexcept {
+		if (needed + s.size() + 1 <= capacity) {
+			std::memcpy(buffer + needed, s.data(), s.size());
+			buffer[needed + s.size()] = '\n';
+		}
+		needed += s.size() + 1;
+	}
+	char *buffer;
+	std::size_t capacity;
+};
+
+// Append ids to a string, one per line.
+class StringSink {
+public:
+	explicit StringSink(std::string &out) : out(out) {}
+	void edge(const Arc *a) { out += a->id; out += '\n'; }
+	void point(const Point *p) { out += p->id; out += '\n'; }
+private:
+	std::string &out;
+};
+
+// Only count; ids are never touched.
+class CountSink {
+public:
+	void edge(const Arc *) noexcept { ++edges; }
+	void point(const Point *) noexcept { ++points; }
+	std::size_t edges{ 0 };
+	std::size_t points{ 0 };
+};
+
+// Call f(id) for every feature.
+template< typename F >
+class CallbackSink {
+public:
+	explicit CallbackSink(F f) : f(f) {}
+	void edge(const Arc *a) { f(a->id); }
+	void point(const Point *p) { f(p->id); }
+private:
+	F f;
+};
+template< typename F > CallbackSink<F> makeCallbackSink(F f) {
+	return CallbackSink<F>(f);
+}
+
+// Collect pointers to the ids; they stay valid as long as the Network does.
+class IdVectorSink {
+public:
+	void edge(const Arc *a) { ids.push_back(&a->id); }
+	void point(const Point *p) { ids.push_back(&p->id); }
+	std::vector<const std::string*> ids;
+};
+
+// Set a bit per point number and per edge row.
+class BitsetSink {
+public:
+	BitsetSink(std::size_t pointCount, std::size_t edgeCount) : points(pointCount), edges(edgeCount) {}
+	void edge(const Arc *a) { edges[a->index] = true; }
+	void point(const Point *p) { points[p->index] = true; }
+	std::vector<bool> points;
+	std::vector<bool> edges;
+};
+
+#endif //ndef INCLUDED_SINK
@@ -0,0 +1,67 @@
+#include "UpstreamIterator.h"
+
+#include "Network.h"
+#include "BCNode.h"
+#include "Point.h"
+#include "Arc.h"
+
+UpstreamIterator::UpstreamIterator(Network *net) : net(net) {
+	net->buildIndex();
+	++net->epoch;
+	advance();
+}
+
+void UpstreamIterator::enter(Index v, Index parent) {
+	net->nodes[v].visited = net->epoch;
+	stack.push_back({ v, parent, 0, 0 });
+}
+
+// Same order as Network::floodFromStartnode: contents of a node,
+// then recurse into its marked neighbors.
+void UpstreamIterator::advance() {
+	for (;;) {
+		if (stack.empty()) {
+			const auto &starts = net->startNodes;
+			while (nextStart < starts.size() && net->nodes[starts[nextStart]].visited == net->epoch) ++nextStart;
+			if (nextStart == starts.size()) {
+				current = nullptr;
+				return;
+			}
+			enter(starts[nextStart++], NoIndex);
+		}
+
+		Frame &f = stack.back();
+		const BCNode &v = net->nodes[f.node];
+		const size_t edgeCount = v.edgesSize;
+		if (f.item < edgeCount) {
+			current = &net->arcs[net->nodeEdges(v)[f.item++]].id;
+			return;
+		}
+		if (v.isBridge()) {
+			// Bridge: controllers, then starts
+			while (f.item < edgeCount + 4) {
+				const size_t slot = f.item++ - edgeCount;
+				const Index p = net->nodePoints(v)[slot & 1];
+				if (slot < 2 ? net->pointTree[p].isController : net->pointTree[p].isStart) {
+					current = &net->points[p].id;
+					return;
+				}
+			}
+		}
+		else if (f.item < edgeCount + v.pointsSize) {
+			current = &net->points[net->nodePoints(v)[f.item++ - edgeCount]].id;
+			return;
+		}
+
+		bool descended = false;
+		while (f.neighbor < v.neighborCount) {
+			const BCNode::Neighbor &n = net->nodeNeighbors(v)[f.neighbor++];
+			if (n.to != f.parent && n.marked && net->nodes[n.to].visited != net->epoch) {
+				enter(n.to, f.node); // invalidates f
+				descended = true;
+				break;
+			}
+		}
+		if (!descended) stack.pop_back();
+	}
+}
@@ -0,0 +1,73 @@
+// Lazy enumeration of upstream features, see
+// Network::upstreamFeatures()
+
+#ifndef INCLUDED_UPSTREAM_ITERATOR
+#define INCLUDED_UPSTREAM_ITERATOR
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <iterator>
+
+#include "Settings.h"
+
+class Network;
+
+// === Description ===
+// Walks the same block-cut tree flood as Network::floodFromStartnode, but
+// one id at a time with an explicit stack instead of recursion. Nothing is
+// buffered, so stopping early costs only what has been consumed.
+//
+// Usage: for (const std::string &id : net.upstreamFeatures()) {
+//            if (id == wanted) break;
+//        }
+//
+// Only one enumeration per Network can be in progress at a time: they share
+// the visited marks in the block-cut tree.
+
+class UpstreamIterator {
+public:
+	using iterator_category = std::input_iterator_tag;
+	using value_type = std::string;
+	using difference_type = std::ptrdiff_t;
+	using pointer = const std::string*;
+	using reference = const std::string&;
+
+	// End iterator
+	UpstreamIterator() = default;
+	// Start a new enumeration on net
+	explicit UpstreamIterator(Network *net);
+
+	reference operator*() const noexcept { return *current; }
+	pointer operator->() const noexcept { return current; }
+	UpstreamIterator &operator++() { advance(); return *this; }
+
+	bool operator==(const UpstreamIterator &other) const noexcept { return current == other.current; }
+	bool operator!=(const UpstreamIterator &other) const noexcept { return current != other.current; }
+
+private:
+	struct Frame {
+		Index node;
+		Index parent;
+		size_t item;     // next content item: edges first, then points
+		size_t neighbor; // next neighbor to consider
+	};
+	void enter(Index v, Index parent);
+	void advance();
+
+	Network *net{ nullptr };
+	size_t nextStart{ 0 };
+	std::vector<Frame> stack;
+	const std::string *current{ nullptr };
+};
+
+class UpstreamRange {
+public:
+	explicit UpstreamRange(Network *net) : net(net) {}
+	UpstreamIterator begin() const { return UpstreamIterator(net); }
+	UpstreamIterator end() const { return UpstreamIterator(); }
+private:
+	Network *net;
+};
+
+#endif //ndef INCLUDED_UPSTREAM_ITERATOR
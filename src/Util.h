@@ -3,6 +3,9 @@
 
 #include <string>
 #include <unordered_map>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <xmmintrin.h>
+#endif
 
 // Helper function for making a dictionary:
 //   If key exists in map, return value.
@@ -16,4 +19,13 @@ T *getOrMake(Allocator &alloc, std::unordered_map<std::string, T*, Hasher> &m, c
 	return v;
 }
 
+// Ask for the cache line at p to be loaded, without waiting for it.
+inline void prefetch(const void *p) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+	__builtin_prefetch(p);
+#elif defined(_MSC_VER)
+	_mm_prefetch(static_cast<const char*>(p), _MM_HINT_T0);
+#endif
+}
+
 #endif //ndef INCLUDED_UTIL
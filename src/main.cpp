@@ -1,16 +1,27 @@
 static const char USAGE[] = R"(Wupstream.
 Usage:
-  wupstream <network> <starting_points> [<output>] [--quick-parser|--dirty-parser]
+  wupstream <network> <starting_points> [<output>] [--quick-parser|--dirty-parser|--controllers=<file>|--pipeline] [--sort-ids|--intern-ids] [--threads=<n>] [--count] [--contract-chains] [--peel-trees] [--relabel=<order>]
+  wupstream --convert <network> <output> [--controllers=<file>]
   wupstream (-h | --help)
 
 Arguments:
-  network          Input file in json format.
+  network          Input file in json or binary format, json possibly gzip or zstd; - for stdin.
   starting_points  Starting points in text format.
   output           Output file; if omitted, output to stdout.
 
 Options:
   -q --quick-parser  Faster, but might fail. Read the source for conditions.
   -d --dirty-parser  Probably fastest if it works, but might crash or silently fail.
+  --controllers=<file>  One row per line (NDJSON or CSV); controller ids in <file>.
+  --pipeline         Read, tokenize and build on separate threads (default parser).
+  --sort-ids         Resolve ids by sorting them all (default parser, --controllers).
+  --intern-ids       Number ids on the parsing threads (--controllers).
+  --threads=<n>      Parse in n parts (--controllers) and sort ids (--sort-ids) on n threads; default one per core.
+  -c --count         Only output the number of upstream points and edges.
+  --contract-chains  Contract chains of degree-2 points before the DFS.
+  --peel-trees       Peel trees off the 2-core before the DFS.
+  --relabel=<order>  Renumber points before the DFS: bfs, rcm or dfs.
+  --convert          Write the network in binary format (see BinaryNetwork.h) to <output>.
   -h --help          Show this screen.
 )";
 
@@ -25,9 +36,13 @@ using std::ofstream;
 #include <string>
 using std::string;
 
+#include <cstdlib>
+
 #include "docopt.h"
 
 #include "Network.h"
+#include "BinaryNetwork.h"
+#include "ChunkReader.h"
 #include "Timer.h"
 #include "Log.h"
 
@@ -38,10 +53,70 @@ int main(int argc, char **argv) {
 		"Wupstream");  // version string
 	
 	string network_filename = args["<network>"].asString();
+	const string controllers_filename = args["--controllers"] ? args["--controllers"].asString() : string();
+
+	// Convert network to binary
+	if (args["--convert"].asBool()) {
+		Network net;
+		const bool loaded = controllers_filename.empty() ? net.load(network_filename, "") : net.load_lines(network_filename, controllers_filename, "");
+		if (!loaded || !net.save_binary(args["<output>"].asString())) return 1;
+		std::exit(0);
+	}
+
 	string starting_flename = args["<starting_points>"].asString();
 	const bool quick_parser = args["--quick-parser"].asBool();
 	const bool dirty_parser = args["--dirty-parser"].asBool();
+	const bool pipeline = args["--pipeline"].asBool();
+	const bool sort_ids = args["--sort-ids"].asBool();
+	const bool intern_ids = args["--intern-ids"].asBool();
+	const bool count_only = args["--count"].asBool();
+	unsigned threads = 0;
+	if (args["--threads"]) {
+		const string n = args["--threads"].asString();
+		threads = static_cast<unsigned>(std::strtoul(n.c_str(), nullptr, 10));
+		if (threads == 0 || n.find_first_not_of("0123456789") != string::npos) {
+			cerr << "Number of threads must be a positive number, not " << n << "\n";
+			return 1;
+		}
+	}
+	const bool contract_chains = args["--contract-chains"].asBool();
+	const bool peel_trees = args["--peel-trees"].asBool();
+	Network::Relabeling relabeling = Network::Relabeling::None;
+	if (args["--relabel"]) {
+		const string order = args["--relabel"].asString();
+		if (order == "bfs") relabeling = Network::Relabeling::BFS;
+		else if (order == "rcm") relabeling = Network::Relabeling::RCM;
+		else if (order == "dfs") relabeling = Network::Relabeling::DFS;
+		else {
+			cerr << "Unknown relabeling order " << order << "\n";
+			return 1;
+		}
+	}
 
+	// Only load_lines parses on several threads that can number the ids
+	if (intern_ids && controllers_filename.empty()) {
+		cerr << "--intern-ids only works with --controllers\n";
+		return 1;
+	}
+
+	// The other loaders parse on one thread
+	if (threads != 0 && controllers_filename.empty() && !sort_ids) {
+		cerr << "--threads only works with --controllers or --sort-ids\n";
+		return 1;
+	}
+
+	// Sorting ids needs all rows at once, which only these loaders have
+	if (sort_ids && controllers_filename.empty()) {
+		const char *problem = nullptr;
+		if (quick_parser || dirty_parser || pipeline) problem = "with --quick-parser, --dirty-parser or --pipeline";
+		else if (isStream(network_filename)) problem = "for standard input or pipes";
+		else if (detectCompression(network_filename) != Compression::None) problem = "for compressed files";
+		else if (isBinaryNetwork(network_filename)) problem = "for binary networks";
+		if (problem != nullptr) {
+			cerr << "--sort-ids does not work " << problem << ": only for the default parser on an uncompressed json file, or with --controllers\n";
+			return 1;
+		}
+	}
 
 	ofstream output_file;
 	if (args["<output>"]) {
@@ -57,28 +132,46 @@ int main(int argc, char **argv) {
 
 	// Load network from file
 	Network net;
+	net.useChainContraction = contract_chains;
+	net.usePeeling = peel_trees;
+	net.relabeling = relabeling;
+	net.usePipeline = pipeline;
+	net.sortIds = sort_ids;
+	net.internIds = intern_ids;
+	net.loadThreads = threads;
+	bool loaded;
 	if (quick_parser) {
-		net.load_quick(network_filename, starting_flename);
+		loaded = net.load_quick(network_filename, starting_flename);
 	}
 	else if (dirty_parser) {
-		net.load_dirty(network_filename, starting_flename);
+		loaded = net.load_dirty(network_filename, starting_flename);
+	}
+	else if (!controllers_filename.empty()) {
+		loaded = net.load_lines(network_filename, controllers_filename, starting_flename);
 	}
 	else {
-		net.load(network_filename, starting_flename);
+		loaded = net.load(network_filename, starting_flename);
 	}
+	if (!loaded) return 1;
 	
 	// Compute and output upstream features
-	if (output_file.is_open()) {
-		net.enumerateUpstreamFeatures(&output_file);
+	std::ostream &out = output_file.is_open() ? static_cast<std::ostream&>(output_file) : cout;
+	if (count_only) {
+		const UpstreamCount count = net.countUpstreamFeatures();
+		out << count.points << ' ' << count.edges << '\n';
 	}
 	else {
-		net.enumerateUpstreamFeatures(&cout);
+		net.enumerateUpstreamFeatures(&out);
 	}
 	
 	// Done.
 	log() << "\n\nTotal time: ";
 	totalTime.report();
 
-	return 0;
+	// Leave without destructing the network, which would free every id
+	// separately. exit does not destruct locals, so close the output first.
+	out.flush();
+	if (output_file.is_open()) output_file.close();
+	std::exit(0);
 
 }
@@ -0,0 +1,108 @@
+// Implementation of the C interface in wupstream.h.
+// No exception may escape into C, so every entry point catches everything.
+
+#include "wupstream.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "Network.h"
+
+struct wup_network {
+	Network net;
+};
+
+int wup_api_version(void) {
+	return WUP_API_VERSION;
+}
+
+wup_network *wup_load(const char *network_filename, int parser) {
+	if (network_filename == nullptr) return nullptr;
+	try {
+		// Owned here until the load succeeds, so that a throw frees it too
+		std::unique_ptr<wup_network> handle(new wup_network);
+		bool loaded = false;
+		switch (parser) {
+		case WUP_PARSER_DEFAULT: loaded = handle->net.load(network_filename, ""); break;
+		case WUP_PARSER_QUICK:   loaded = handle->net.load_quick(network_filename, ""); break;
+		case WUP_PARSER_DIRTY:   loaded = handle->net.load_dirty(network_filename, ""); break;
+		}
+		return loaded ? handle.release() : nullptr;
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+wup_network *wup_load_lines(const char *network_filename, const char *controllers_filename) {
+	if (network_filename == nullptr || controllers_filename == nullptr) return nullptr;
+	try {
+		std::unique_ptr<wup_network> handle(new wup_network);
+		return handle->net.load_lines(network_filename, controllers_filename, "") ? handle.release() : nullptr;
+	}
+	catch (...) {
+		return nullptr;
+	}
+}
+
+int wup_build_index(wup_network *handle) {
+	if (handle == nullptr) return -1;
+	try {
+		handle->net.renderBCTree();
+		handle->net.compact();
+		return 0;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+
+size_t wup_query(wup_network *handle, const char *const *start_ids, size_t start_count, char *buffer, size_t buffer_size) {
+	if (handle == nullptr || (start_ids == nullptr && start_count > 0) || (buffer == nullptr && buffer_size > 0)) return WUP_ERROR;
+	try {
+		std::vector<std::string> starts(start_ids, start_ids + start_count);
+		std::vector<TextRange> pieces;
+		handle->net.upstreamText(starts, pieces);
+		size_t needed = 0;
+		for (const TextRange &r : pieces) {
+			if (needed + r.size <= buffer_size) {
+				std::memcpy(buffer + needed, r.data, r.size);
+			}
+			needed += r.size;
+		}
+		return needed;
+	}
+	catch (...) {
+		return WUP_ERROR;
+	}
+}
+
+int wup_count(wup_network *handle, const char *const *start_ids, size_t start_count, size_t *points, size_t *edges) {
+	if (handle == nullptr || (start_ids == nullptr && start_count > 0) || points == nullptr || edges == nullptr) return -1;
+	try {
+		std::vector<std::string> starts(start_ids, start_ids + start_count);
+		const UpstreamCount count = handle->net.countUpstreamFeatures(starts);
+		*points = count.points;
+		*edges = count.edges;
+		return 0;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+
+int wup_is_upstream(wup_network *handle, const char *feature_id, const char *start_id) {
+	if (handle == nullptr || feature_id == nullptr || start_id == nullptr) return -1;
+	try {
+		return handle->net.isUpstream(feature_id, start_id) ? 1 : 0;
+	}
+	catch (...) {
+		return -1;
+	}
+}
+
+void wup_free(wup_network *handle) {
+	delete handle;
+}
@@ -0,0 +1,85 @@
+/* C interface to Wupstream, for use as a library from other languages.
+ *
+ * Load a network once, then ask any number of upstream queries:
+ *
+ *   wup_network *net = wup_load("network.json", WUP_PARSER_DEFAULT);
+ *   if (net == NULL) ...;
+ *   wup_build_index(net);
+ *   const char *start[] = { "{4C2D...}" };
+ *   size_t n = wup_query(net, start, 1, buffer, sizeof buffer);
+ *   if (n == WUP_ERROR) ...
+ *   else if (n > sizeof buffer) ... buffer too small, n bytes are needed ...
+ *   wup_free(net);
+ *
+ * A network handle must not be used by two threads at the same time.
+ * Different handles are independent.
+ */
+
+#ifndef INCLUDED_WUPSTREAM
+#define INCLUDED_WUPSTREAM
+
+#include <stddef.h>
+
+#if defined(_WIN32) && defined(WUP_BUILD_SHARED)
+#define WUP_API __declspec(dllexport)
+#elif defined(__GNUC__)
+#define WUP_API __attribute__((visibility("default")))
+#else
+#define WUP_API
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Incremented whenever a function in this file changes incompatibly. */
+#define WUP_API_VERSION 1
+WUP_API int wup_api_version(void);
+
+typedef struct wup_network wup_network;
+
+/* Which parser to use, see the README. */
+#define WUP_PARSER_DEFAULT 0
+#define WUP_PARSER_QUICK   1
+#define WUP_PARSER_DIRTY   2
+
+/* Load a network file. Returns NULL if it cannot be loaded. */
+WUP_API wup_network *wup_load(const char *network_filename, int parser);
+
+/* Load a network with one row per line (NDJSON or CSV via,from,to) and the
+ * controller ids in a separate file, see Network::load_lines in Network.h.
+ * Returns NULL if it cannot be loaded. */
+WUP_API wup_network *wup_load_lines(const char *network_filename, const char *controllers_filename);
+
+/* Build the block-cut tree and render its contents for wup_query, then
+ * release the memory that was only needed to build it. Optional: the first
+ * query builds the tree otherwise, but keeps that memory. Returns 0 on success. */
+WUP_API int wup_build_index(wup_network *net);
+
+/* Write the upstream features of the given start points and edges into
+ * buffer, one id per line (ids may occur more than once). The text is copied
+ * from pre-rendered blocks in O(log n) pieces per start.
+ * Returns the number of bytes the full answer takes. If that is more than
+ * buffer_size, the buffer holds only part of it, and the query can be
+ * repeated with a larger buffer. Returns WUP_ERROR on error. */
+#define WUP_ERROR ((size_t)-1)
+WUP_API size_t wup_query(wup_network *net, const char *const *start_ids, size_t start_count, char *buffer, size_t buffer_size);
+
+/* Count the distinct upstream points and edges of the given start ids, without
+ * producing any ids. Edges are counted per row of the network file.
+ * Returns 0 on success. */
+WUP_API int wup_count(wup_network *net, const char *const *start_ids, size_t start_count, size_t *points, size_t *edges);
+
+/* Is the point or edge feature_id upstream of the start point or edge start_id?
+ * Answered without enumerating the upstream features.
+ * Returns 1 if it is, 0 if it is not, and -1 on error. */
+WUP_API int wup_is_upstream(wup_network *net, const char *feature_id, const char *start_id);
+
+/* Release the network; the handle cannot be used afterwards. NULL is ignored. */
+WUP_API void wup_free(wup_network *net);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ndef INCLUDED_WUPSTREAM */
@@ -1,7 +1,7 @@
 """Run a very simple and unscientific benchmark
 
 Usage:
-  bench.py <program> <instance> [--repeats=N] [--network=FILE] [--start=FILE]
+  bench.py <program> <instance> [--repeats=N] [--network=FILE] [--start=FILE] [--args=ARGS] [--perf]
   bench.py (-h | --help)
 
 Arguments:
@@ -12,10 +12,13 @@ Options:
   -r --repeats N      Number of repeats [default: 20]
   -n --network FILE   Filename of the network [default: network.json]
   -s --start FILE     Filename of the starting points [default: start.txt]
+  -a --args ARGS      Extra arguments for the program, separated by spaces
+  -p --perf           Run under perf stat and report cache and TLB misses
   -h --help           Show this screen.
 
 """
 import sys
+import shutil
 import subprocess
 
 from docopt import docopt
@@ -53,9 +56,27 @@ except ValueError:
     rint('Repeats argument is not a number:', arguments['--timeout'])
     sys.exit()
 
-    
+extra = arguments['--args'].split() if arguments['--args'] else []
+events = ['cache-misses', 'dTLB-load-misses']
+perf = ['perf', 'stat', '-x', ',', '-e', ','.join(events)] if arguments['--perf'] else []
+if perf and shutil.which('perf') is None:
+    print('perf is not installed')
+    sys.exit()
+misses = {}
+
 for _ in range(repeats):
-    subprocess.run([command,network_filename,starting_filename,result_filename], cwd=base, check=True)
+    run = subprocess.run(perf+[command,network_filename,starting_filename,result_filename]+extra, cwd=base, check=True,
+                         stderr=subprocess.PIPE if perf else None, universal_newlines=True)
+    if perf:
+        # perf writes value,unit,event,... to stderr; the value is not a number if unsupported
+        for line in run.stderr.splitlines():
+            fields = line.split(',')
+            if len(fields) > 2 and fields[2].split(':')[0] in events and fields[0].isdigit():
+                event = fields[2].split(':')[0]
+                misses[event] = misses.get(event, 0) + int(fields[0])
 end = timer()
 print( '   Time:', end-start )
-print( 'Average:', (end-start)/repeats )
\ No newline at end of file
+print( 'Average:', (end-start)/repeats )
+if perf:
+    for event in events:
+        print( event, 'per run:', misses[event] // repeats if event in misses else 'not available' )
\ No newline at end of file
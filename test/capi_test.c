@@ -0,0 +1,158 @@
+/* Test of the C interface in src/wupstream.h.
+ *
+ * Usage: capi_test <instance>...
+ *
+ * Every instance is a folder with network.json, start.txt and expected.txt,
+ * as for run_tests.py. The network is loaded and indexed with
+ * wup_build_index (so the queries run on the compacted network), then
+ * wup_query must give the ids in expected.txt, and wup_is_upstream must
+ * say that each of them is upstream of one of the start ids.
+ * Exits with 1 if any instance fails. See the README for how to build it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wupstream.h"
+
+typedef struct {
+	char **ids;
+	size_t count;
+	char *text; /* the ids point into this */
+} id_list;
+
+static int compare_ids(const void *a, const void *b) {
+	return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/* Split text at white space into ids, sorted and without duplicates. Takes text. */
+static id_list split_ids(char *text) {
+	id_list list = { NULL, 0, text };
+	size_t capacity = 0, unique = 0, i;
+	char *id;
+	for (id = strtok(text, " \t\r\n"); id != NULL; id = strtok(NULL, " \t\r\n")) {
+		if (list.count == capacity) {
+			capacity = capacity == 0 ? 64 : 2 * capacity;
+			list.ids = (char **)realloc(list.ids, capacity * sizeof *list.ids);
+		}
+		list.ids[list.count++] = id;
+	}
+	if (list.count == 0) return list;
+	qsort(list.ids, list.count, sizeof *list.ids, compare_ids);
+	for (i = 1; i < list.count; ++i) {
+		if (strcmp(list.ids[i], list.ids[unique]) != 0) list.ids[++unique] = list.ids[i];
+	}
+	list.count = unique + 1;
+	return list;
+}
+
+static void free_ids(id_list *list) {
+	free(list->ids);
+	free(list->text);
+}
+
+/* The whole file as a string, or NULL */
+static char *read_file(const char *folder, const char *name) {
+	char path[4096];
+	FILE *fp;
+	char *text;
+	long size;
+	snprintf(path, sizeof path, "%s/%s", folder, name);
+	fp = fopen(path, "rb");
+	if (fp == NULL) return NULL;
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+	text = (char *)malloc((size_t)size + 1);
+	if (fread(text, 1, (size_t)size, fp) != (size_t)size) {
+		free(text);
+		text = NULL;
+	}
+	else text[size] = '\0';
+	fclose(fp);
+	return text;
+}
+
+/* The answer of wup_query, in a buffer that is enlarged until it fits */
+static char *query(wup_network *net, const id_list *starts) {
+	size_t size = 1024, needed;
+	char *buffer = (char *)malloc(size + 1);
+	while ((needed = wup_query(net, (const char *const *)starts->ids, starts->count, buffer, size)) > size) {
+		if (needed == WUP_ERROR) {
+			free(buffer);
+			return NULL;
+		}
+		size = needed;
+		buffer = (char *)realloc(buffer, size + 1);
+	}
+	buffer[needed] = '\0';
+	return buffer;
+}
+
+static const char *test_instance(const char *folder) {
+	char path[4096];
+	wup_network *net;
+	char *start_text, *expected_text, *answer;
+	id_list starts, expected, found;
+	const char *problem = NULL;
+	size_t i, s;
+
+	start_text = read_file(folder, "start.txt");
+	expected_text = read_file(folder, "expected.txt");
+	if (start_text == NULL || expected_text == NULL) {
+		free(start_text);
+		free(expected_text);
+		return "cannot read start.txt or expected.txt";
+	}
+	starts = split_ids(start_text);
+	expected = split_ids(expected_text);
+
+	snprintf(path, sizeof path, "%s/network.json", folder);
+	net = wup_load(path, WUP_PARSER_DEFAULT);
+	if (net == NULL) problem = "wup_load failed";
+	else if (wup_build_index(net) != 0) problem = "wup_build_index failed";
+	else if ((answer = query(net, &starts)) == NULL) problem = "wup_query failed";
+	else {
+		found = split_ids(answer);
+		if (found.count != expected.count) problem = "wup_query gives other ids than expected.txt";
+		for (i = 0; problem == NULL && i < found.count; ++i) {
+			if (strcmp(found.ids[i], expected.ids[i]) != 0) problem = "wup_query gives other ids than expected.txt";
+		}
+		for (i = 0; problem == NULL && i < found.count; ++i) {
+			int upstream = 0;
+			for (s = 0; s < starts.count && upstream == 0; ++s) {
+				upstream = wup_is_upstream(net, found.ids[i], starts.ids[s]);
+				if (upstream < 0) problem = "wup_is_upstream failed";
+			}
+			if (upstream == 0) problem = "wup_is_upstream says an upstream id is not upstream";
+		}
+		free_ids(&found);
+	}
+	wup_free(net);
+	free_ids(&starts);
+	free_ids(&expected);
+	return problem;
+}
+
+int main(int argc, char **argv) {
+	int i, failed = 0;
+	if (argc < 2) {
+		fprintf(stderr, "Usage: capi_test <instance>...\n");
+		return 2;
+	}
+	if (wup_api_version() != WUP_API_VERSION) {
+		fprintf(stderr, "Library has API version %d, header %d\n", wup_api_version(), WUP_API_VERSION);
+		return 1;
+	}
+	for (i = 1; i < argc; ++i) {
+		const char *problem = test_instance(argv[i]);
+		printf("%-35s [ %s ]\n", argv[i], problem == NULL ? "PASS" : "FAIL");
+		if (problem != NULL) {
+			printf("    %s\n", problem);
+			failed = 1;
+		}
+	}
+	printf("Done.\n");
+	return failed;
+}
@@ -0,0 +1,33 @@
+"""Write a network with one row per line, for --controllers.
+
+Usage: json_to_lines.py <folder> [quoted]
+
+Reads network.json in the folder and writes there network.ndjson, network.csv
+and controllers.txt. The CSV has a header line and CRLF line ends; with
+quoted, it has no header, LF line ends, and the via and to ids in quotes.
+"""
+import sys
+import json
+
+if len(sys.argv) not in (2, 3) or sys.argv[2:] not in ([], ['quoted']):
+    print(__doc__)
+    exit()
+folder = sys.argv[1]
+quoted = len(sys.argv) == 3
+
+with open(folder + '/network.json') as f:
+    net = json.load(f)
+rows = net['rows']
+
+with open(folder + '/network.ndjson', 'w', newline='') as f:
+    for r in rows:
+        f.write(json.dumps({'fromGlobalId': r['fromGlobalId'], 'viaGlobalId': r['viaGlobalId'], 'toGlobalId': r['toGlobalId']}) + '\n')
+with open(folder + '/network.csv', 'w', newline='') as f:
+    if quoted:
+        q = lambda s: '"' + s.replace('"', '""') + '"'
+        for r in rows: f.write('%s,%s,%s\n' % (q(r['viaGlobalId']), r['fromGlobalId'], q(r['toGlobalId'])))
+    else:
+        f.write('viaGlobalId,fromGlobalId,toGlobalId\r\n')
+        for r in rows: f.write('%s,%s,%s\r\n' % (r['viaGlobalId'], r['fromGlobalId'], r['toGlobalId']))
+with open(folder + '/controllers.txt', 'w') as f:
+    for c in net['controllers']: f.write(c['globalId'] + '\n')
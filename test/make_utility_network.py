@@ -0,0 +1,61 @@
+"""Make a large network that looks like a utility network, for benchmarks.
+
+Usage: make_utility_network.py radial|meshed <rows> <seed> <folder>
+
+Grows a network from one controller by attaching, to a random device, either
+a chain of 1-25 conductor segments ending in a new device, a small service
+tree, or a row that closes a loop to another device. The radial kind has few
+loops (70% chains, 25% trees, 5% loops); the meshed kind has many (60% chains,
+10% trees, 30% loops). Ids look like GUIDs. Rows are shuffled. Writes
+network.json and start.txt (10 random points) to the folder, which must exist.
+The same arguments give the same files.
+"""
+import sys
+import random
+
+if len(sys.argv) != 5 or sys.argv[1] not in ('radial', 'meshed'):
+    print(__doc__)
+    exit()
+
+chains, trees = (0.7, 0.95) if sys.argv[1] == 'radial' else (0.6, 0.7)
+target = int(sys.argv[2])
+random.seed(int(sys.argv[3]))
+folder = sys.argv[4]
+
+def gid(i):
+    h = '%032X' % (i * 2654435761 % (1<<128))
+    return '{%s-%s-%s-%s-%s}' % (h[:8],h[8:12],h[12:16],h[16:20],h[20:32])
+
+rows = []
+n = 1
+devices = [0]
+def edge(a, b):
+    rows.append((gid(10**9 + len(rows) + 1), gid(a), gid(b)))
+
+while len(rows) < target:
+    r = random.random()
+    u = random.choice(devices)
+    if r < chains:
+        prev = u
+        for _ in range(random.randint(1, 25)):
+            edge(prev, n); prev = n; n += 1
+        devices.append(prev)
+    elif r < trees:
+        prev = u
+        for _ in range(random.randint(1, 4)):
+            edge(prev, n)
+            if random.random() < 0.5: prev = n
+            n += 1
+    else:
+        v = random.choice(devices)
+        if v != u: edge(u, v)
+random.shuffle(rows)
+
+with open(folder + '/network.json', 'w') as f:
+    f.write('{\n  "rows": [\n')
+    f.write(',\n'.join('    {\n      "viaGlobalId": "%s",\n      "fromGlobalId": "%s",\n      "toGlobalId": "%s"\n    }' % r for r in rows))
+    f.write('\n  ],\n  "controllers": [\n    {\n      "globalId": "%s"\n    }\n  ]\n}\n' % gid(0))
+with open(folder + '/start.txt', 'w') as f:
+    for _ in range(10):
+        f.write(gid(random.randrange(1, n)) + '\n')
+print(len(rows), 'rows,', n, 'points')
@@ -1,7 +1,7 @@
 """Run Tests.
 
 Usage:
-  run_tests.py <program> [--list FILE] [--timeout=T]
+  run_tests.py <program> [--list FILE] [--timeout=T] [--count] [--args=ARGS] [--network=FILE] [--stdin] [--convert]
   run_tests.py (-h | --help)
 
 Arguments:
@@ -10,10 +10,22 @@ Arguments:
 Options:
   --list FILE      Specify list of test cases [default: test_list.txt]
   -t --timeout T   Timeout of individual cases, in seconds. [default: 1]
+  -c --count       Run the program with --count, and compare with the number
+                   of points and of rows in the network that expected.txt gives.
+  --args ARGS      More arguments for the program, e.g. --args=--contract-chains
+  --network FILE   Filename of the network in each case [default: network.json]
+  --stdin          Pass the network to the program on standard input, as -
+  --convert        First convert the network to result.bin with --convert
+                   (--controllers in --args goes there), then run on that.
   -h --help        Show this screen.
 
+A case in the list is the folder of the case, optionally followed by ERR if
+the program must fail on it (with a nonzero exit code), and by arguments for
+the program for this case only.
 """
 import sys
+import json
+import shlex
 import subprocess
 
 # Windows might need Colorama for coloured output to work
@@ -45,27 +57,68 @@ def line_set(fname):
     with open(fname) as file:
         return set([line.strip() for line in file.readlines()])
 
+# What --count should give: points and rows (edges count once per row) upstream.
+# A row is upstream if its via and both its points are (two upstream points of
+# one block make the block upstream, also when the via id occurs elsewhere), or
+# if its via is a start edge, of which only one point may be upstream.
+def expected_count(base, expected_lines, start_ids):
+    with open(base+'/network.json') as file:
+        rows = json.load(file)['rows']
+    points = set()
+    for row in rows:
+        points.add(row['fromGlobalId'])
+        points.add(row['toGlobalId'])
+    edges = sum(1 for row in rows if row['viaGlobalId'] in start_ids or (row['viaGlobalId'] in expected_lines
+        and row['fromGlobalId'] in expected_lines and row['toGlobalId'] in expected_lines))
+    return set(['{0} {1}'.format(len(points & expected_lines), edges)])
+
+count_only = arguments['--count']
+program_args = shlex.split(arguments['--args'] or '')
+use_stdin = arguments['--stdin']
+use_convert = arguments['--convert']
+
 with open(arguments['--list']) as f:
     for line in f:
         line = line.strip()
         if len(line)==0: print(); continue
         if line[0]=='#': print(colored(line,'yellow')); continue
-        base = line.split(' ',2)[0]
-        network_filename = 'network.json'
+        base = line.split()[0]
+        must_fail = 'ERR' in line.split()[1:]
+        case_args = [word for word in line.split()[1:] if word != 'ERR']
+        network_filename = arguments['--network']
         starting_filename = 'start.txt'
         result_filename = 'result.txt'
+        binary_filename = 'result.bin'
         expected_filename = 'expected.txt'
         print('{0:35} [ '.format(base+' '),end='')
         try:
-            subprocess.run([command,network_filename,starting_filename,result_filename], cwd=base, check=True, timeout=timeout_arg)
+            extra_args = program_args + case_args + (['--count'] if count_only else [])
+            if use_convert:
+                convert_args = [arg for arg in extra_args if arg.startswith('--controllers')]
+                extra_args = [arg for arg in extra_args if not arg.startswith('--controllers')]
+                subprocess.run([command,'--convert',network_filename,binary_filename]+convert_args, cwd=base, check=True, timeout=timeout_arg)
+                network_filename = binary_filename
+            if use_stdin:
+                with open(base+'/'+network_filename, 'rb') as network_file:
+                    subprocess.run([command,'-',starting_filename,result_filename]+extra_args, cwd=base, check=True, timeout=timeout_arg, stdin=network_file)
+            else:
+                subprocess.run([command,network_filename,starting_filename,result_filename]+extra_args, cwd=base, check=True, timeout=timeout_arg)
+            if must_fail:
+                print(colored('FAIL','red'),']')
+                continue
             result_lines = line_set(base+'/'+result_filename)
             expected_lines = line_set(base+'/'+expected_filename)
+            if count_only: expected_lines = expected_count(base, expected_lines, line_set(base+'/'+starting_filename))
             if set(result_lines) == set(expected_lines):
                 print(colored('PASS','green'),']')
             else:
                 print(colored('FAIL','red'),']')
         except subprocess.CalledProcessError:
-            print(colored('ERR ','magenta'),']')
+            if must_fail: print(colored('PASS','green'),']')
+            else: print(colored('ERR ','magenta'),']')
         except subprocess.TimeoutExpired:
             print(colored('TIME','cyan'),']')
+        except OSError as error:
+            print(error.strerror)
+            print(colored('ERR ','magenta'),']')
 print('Done.')
\ No newline at end of file